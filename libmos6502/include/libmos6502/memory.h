@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 
 namespace LibMos6502
 {
@@ -10,6 +12,12 @@ class Memory
 public:
 	virtual uint8_t read(uint16_t address) = 0;
 	virtual void write(uint16_t address, uint8_t data) = 0;
+
+	// Addresses backed by immutable memory report their offset into that ROM,
+	// which lets the CPU cache decoded instructions. Everything else is notRom.
+	static constexpr size_t notRom{std::numeric_limits<size_t>::max()};
+	virtual size_t romOffset(uint16_t) { return notRom; }
+	virtual size_t romSize() { return 0; }
 };
 
 }
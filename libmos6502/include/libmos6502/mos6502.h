@@ -2,11 +2,12 @@
 #define MOS6502_H
 
 #include <array>
+#include <atomic>
 #include <chrono>
-#include <bitset>
 #include <functional>
 #include <map>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 #if defined(LIBMOS6502_LOG)
@@ -19,10 +20,14 @@
 namespace LibMos6502
 {
 
+// Bus is any type providing uint8_t read(uint16_t) and void write(uint16_t, uint8_t).
+// Instantiating the core over a concrete (final) bus lets the compiler inline every
+// memory access; VirtualMos6502 keeps dispatching through the Memory interface.
+template<typename Bus>
 class Mos6502
 {
 public:
-	Mos6502(NonNullSharedPtr<Memory> memory);
+	Mos6502(NonNullSharedPtr<Bus> memory);
 
 	void reset();
 	void step(
@@ -33,30 +38,106 @@ public:
 
 	uint8_t getCycles();
 
+	// Adds cycleBudget to the cycle balance and executes instructions until the balance is used up
+	// or requestStop() is called, e.g. by the bus when an I/O register is accessed.
+	// Returns the number of cycles executed. Cycles executed past the budget are deducted from the
+	// next call, budget left after a stop remains in the balance.
+	uint32_t run(uint32_t cycleBudget
+#if defined(LIBMOS6502_LOG)
+		, std::ofstream& log
+#endif
+	);
+	void requestStop();
+	int64_t getCycleBalance();
+
+	// Requests a non-maskable interrupt, serviced before the next instruction.
+	void nmi();
+
+	// Cycles executed since power on by completed instructions
+	uint64_t getCycleCount();
+	// Cycle of the bus access in progress, for components called from the bus
+	uint64_t getCurrentCycle();
+	// Suspends the CPU for the given number of cycles, e.g. during DMA
+	void stall(uint16_t cycles);
+
+	// Runs straight-line blocks of ROM code, following chained blocks as long as their worst case
+	// cycle count fits into maxCycles. Code outside of ROM is interpreted by a single step().
+	// Returns the number of cycles executed.
+	uint32_t stepBlock(uint32_t maxCycles
+#if defined(LIBMOS6502_LOG)
+		, std::ofstream& log
+#endif
+	);
+
+	// Decoded instructions are cached by PRG-ROM offset, which stays valid across bank switches.
+	// Has to be called whenever the memory starts reporting a different ROM.
+	void flushDecodeCache();
+	// Uses the decode cache of a CPU running the same ROM instead of decoding it again. The cache
+	// keeps filling as code runs, and CPUs sharing it may run on different threads at once.
+	void shareDecodeCache(const Mos6502& other);
+
+	// Registers and cycle counters between two instructions, e.g. for save states.
+	// The decode caches only depend on the ROM and are kept.
+	struct State
+	{
+		uint64_t m_cycleCount;
+		int64_t m_cycleBalance;
+		uint16_t m_pc;
+		uint8_t m_sp;
+		uint8_t m_acc;
+		uint8_t m_x, m_y;
+		uint8_t m_status;
+		uint8_t m_cycles;
+		bool m_nmiPending;
+	};
+
+	State getState() const;
+	void setState(const State& state);
+
 private:
-	NonNullSharedPtr<Memory> m_memory;
+	NonNullSharedPtr<Bus> m_memory;
 
 	uint16_t m_pc;
 	uint8_t m_sp;
 	uint8_t m_acc;
 	uint8_t m_x, m_y;
 
-	std::bitset<8> m_status;
-	struct StatusBits
+	// N, Z and V are not stored as bits but derived from the results of the last instruction that
+	// affected them. They are only evaluated when a branch tests them or the status is pushed.
+	uint8_t m_flags; // Interrupt, Decimal and the unused bits 4 and 5
+	bool m_carry;
+	uint8_t m_negativeResult; // Negative is bit 7
+	uint8_t m_zeroResult; // Zero if the result was 0
+	uint8_t m_overflowLhs, m_overflowRhs, m_overflowResult; // Overflow if the sum changed both signs
+	struct StatusFlags
 	{
-		static constexpr size_t 
-			Carry { 0 }, 
-			Zero { 1 }, 
-			Interrupt { 2 }, 
-			Decimal { 3 }, 
-			Overflow { 6 }, 
-			Negative { 7 };
-
-		StatusBits() = delete;
+		static constexpr uint8_t 
+			Carry { 0x01 }, 
+			Zero { 0x02 }, 
+			Interrupt { 0x04 }, 
+			Decimal { 0x08 }, 
+			Overflow { 0x40 }, 
+			Negative { 0x80 };
+
+		StatusFlags() = delete;
 	};
 
+	uint8_t getStatus() const;
+	void setStatus(uint8_t status);
+	bool getOverflow() const;
+	void setOverflow(bool overflow);
+
+#if defined(LIBMOS6502_LOG)
+	void writeLog(std::ofstream& log, uint8_t opCode);
+#endif
+
 	uint8_t m_cycles;
+	uint64_t m_cycleCount;
+	int64_t m_cycleBalance;
+	bool m_stopRequested;
+	bool m_nmiPending;
 	uint16_t m_newPc;
+	uint16_t m_operand;
 
 	static constexpr uint16_t pcDefault{0};
 	static constexpr uint8_t spDefault{0xFD};
@@ -75,387 +156,237 @@ private:
 	uint16_t readPage16(uint16_t addr);
 	void write8(uint16_t addr, uint8_t data);
 
-	uint8_t readArg8(uint16_t addr);
-	uint16_t readArg16(uint16_t addr);
-
 	void push8(uint8_t data);
 	void push16(uint16_t data);
 	uint8_t pull8();
 	uint16_t pull16();
 	void pullStatus();
+	void interrupt(uint16_t vector, uint16_t returnAddress, bool brk);
+
+	enum class AddressMode { Acc, Imp, Rel, Imm, ZoP, ZpX, ZpY, Abs, AbX, AbY, Pre, Pos, Ill, Ind };
+
+	static constexpr uint8_t getLength(AddressMode mode)
+	{
+		switch (mode)
+		{
+		case AddressMode::Acc:
+		case AddressMode::Imp:
+		case AddressMode::Ill:
+			return 1;
+		case AddressMode::Abs:
+		case AddressMode::AbX:
+		case AddressMode::AbY:
+		case AddressMode::Ind:
+			return 3;
+		default:
+			return 2;
+		}
+	}
+
+	static constexpr bool isControlFlow(std::string_view name, AddressMode mode)
+	{
+		return mode == AddressMode::Rel ||
+			name == "JMP" || name == "JSR" || name == "RTS" || name == "RTI" || name == "BRK";
+	}
 
-	uint16_t readAddress(bool assumePageCross);
+	// Worst case addition to the base cycles: page crossing, or a taken branch to another page
+	static constexpr uint8_t getPenalty(AddressMode mode)
+	{
+		switch (mode)
+		{
+		case AddressMode::Rel:
+			return 2;
+		case AddressMode::AbX:
+		case AddressMode::AbY:
+		case AddressMode::Pos:
+			return 1;
+		default:
+			return 0;
+		}
+	}
+
+	template<AddressMode mode> uint16_t readAddress(bool assumePageCross = false);
+	template<AddressMode mode> uint8_t readValue();
 
 	void setNZ(uint8_t src);
 
-	void ADC();
-	void SBC();
-	void AND();
-	void ASL();
-	void BIT();
-	void BRK();
-
-	void compare(uint8_t reg);
-	void CMP();
-	void CPX();
-	void CPY();
+	template<AddressMode mode> void ADC();
+	template<AddressMode mode> void SBC();
+	template<AddressMode mode> void AND();
+	template<AddressMode mode> void ASL();
+	template<AddressMode mode> void BIT();
+	template<AddressMode mode> void BRK();
+
+	template<AddressMode mode> void compare(uint8_t reg);
+	template<AddressMode mode> void CMP();
+	template<AddressMode mode> void CPX();
+	template<AddressMode mode> void CPY();
 	
-	void EOR();
+	template<AddressMode mode> void EOR();
 
 	uint8_t decrement(uint8_t src);
 	uint8_t increment(uint8_t src);
-	void DEC();
-	void DEX();
-	void DEY();
-	void INC();
-	void INX();
-	void INY();
-
-	void JMP();
-	void JSR();
-	void LSR();
-	void NOP();
-	void ORA();
-	void ROL();
-	void ROR();
-	void RTI();
-	void RTS();
-
-	void TAX();
-	void TAY();
-	void TSX();
-	void TXA();
-	void TXS();
-	void TYA();
-
-	void STA();
-	void STX();
-	void STY();
-
-	void SEC();
-	void SED();
-	void SEI();
-
-	void branch(bool condition);
-	void BCC();
-	void BCS();
-	void BEQ();
-	void BMI();
-	void BNE();
-	void BPL();
-	void BVC();
-	void BVS();
-
-	void CLC();
-	void CLD();
-	void CLI();
-	void CLV();
-
-	void LDA();
-	void LDX();
-	void LDY();
-
-	void PHA();
-	void PHP();
-	void PLA();
-	void PLP();
-
-	void ILL();
-
-	enum class AddressMode { Acc, Imp, Rel, Imm, ZoP, ZpX, ZpY, Abs, AbX, AbY, Pre, Pos, Ill, Ind };
+	template<AddressMode mode> void DEC();
+	template<AddressMode mode> void DEX();
+	template<AddressMode mode> void DEY();
+	template<AddressMode mode> void INC();
+	template<AddressMode mode> void INX();
+	template<AddressMode mode> void INY();
+
+	template<AddressMode mode> void JMP();
+	template<AddressMode mode> void JSR();
+	template<AddressMode mode> void LSR();
+	template<AddressMode mode> void NOP();
+	template<AddressMode mode> void ORA();
+	template<AddressMode mode> void ROL();
+	template<AddressMode mode> void ROR();
+	template<AddressMode mode> void RTI();
+	template<AddressMode mode> void RTS();
+
+	template<AddressMode mode> void TAX();
+	template<AddressMode mode> void TAY();
+	template<AddressMode mode> void TSX();
+	template<AddressMode mode> void TXA();
+	template<AddressMode mode> void TXS();
+	template<AddressMode mode> void TYA();
+
+	template<AddressMode mode> void STA();
+	template<AddressMode mode> void STX();
+	template<AddressMode mode> void STY();
+
+	template<AddressMode mode> void SEC();
+	template<AddressMode mode> void SED();
+	template<AddressMode mode> void SEI();
+
+	template<AddressMode mode> void branch(bool condition);
+	template<AddressMode mode> void BCC();
+	template<AddressMode mode> void BCS();
+	template<AddressMode mode> void BEQ();
+	template<AddressMode mode> void BMI();
+	template<AddressMode mode> void BNE();
+	template<AddressMode mode> void BPL();
+	template<AddressMode mode> void BVC();
+	template<AddressMode mode> void BVS();
+
+	template<AddressMode mode> void CLC();
+	template<AddressMode mode> void CLD();
+	template<AddressMode mode> void CLI();
+	template<AddressMode mode> void CLV();
+
+	template<AddressMode mode> void LDA();
+	template<AddressMode mode> void LDX();
+	template<AddressMode mode> void LDY();
+
+	template<AddressMode mode> void PHA();
+	template<AddressMode mode> void PHP();
+	template<AddressMode mode> void PLA();
+	template<AddressMode mode> void PLP();
+
+	template<AddressMode mode> void ILL();
+
+	using Handler = void(*)(Mos6502&);
+
+	// Binds an instruction specialized for one addressing mode to a plain function pointer,
+	// so dispatching an opcode is a single indirect call without member pointer adjustment.
+	// The operand has to be decoded into m_operand already.
+	template<void(Mos6502::* instruction)(), AddressMode mode>
+	static void execute(Mos6502& cpu)
+	{
+		cpu.m_cycles += getLength(mode); // opcode and operand fetch
+		cpu.m_newPc = cpu.m_pc + getLength(mode);
+		(cpu.*instruction)();
+	}
+
+	// Same as execute, but fetches the operand from memory first.
+	template<void(Mos6502::* instruction)(), AddressMode mode>
+	static void fetchAndExecute(Mos6502& cpu)
+	{
+		cpu.fetchOperand<mode>();
+		(cpu.*instruction)();
+	}
 
-	AddressMode m_addrMode;
+	template<AddressMode mode> void fetchOperand();
 
-	typedef struct
+	struct Instruction
 	{
-		void(Mos6502::* m_instruction)();
+		Handler m_handler;
+		Handler m_fetchHandler;
 		AddressMode m_addressMode;
+		uint8_t m_length;
+		uint8_t m_cycles;
+		bool m_controlFlow;
 #if defined(LIBMOS6502_LOG)
-		std::string m_name;
+		const char* m_name;
 #endif
-	} Instruction;
+	};
 
-#if defined(LIBMOS6502_LOG)
-#define I(instruction, addressMode) { &Mos6502::instruction, AddressMode::addressMode, #instruction }
-#else
-#define I(instruction, addressMode) { &Mos6502::instruction, AddressMode::addressMode }
-#endif // defined(LIBMOS6502_LOG)
-	std::vector<Instruction> m_instructions
+	static const std::array<Instruction, 256> instructions;
+
+	// The instruction length is implied by the handler's addressing mode.
+	struct DecodedInstruction
+	{
+		Handler m_handler;
+		uint16_t m_operand;
+		uint8_t m_opCode;
+	};
+
+	// A straight-line run of ROM instructions within one page. Blocks end at control flow and before
+	// any instruction that may write outside internal RAM or read from I/O registers, so a block
+	// never interacts with other components and the bank it lives in cannot change under it.
+	// Only the links change once a block is built.
+	struct Block
 	{
-		I(ILL, Ill), // 0x00
-		I(ORA, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ORA, ZoP),
-		I(ASL, ZoP),
-		I(ILL, Ill),
-		I(PHP, Imp),
-		I(ORA, Imm),
-		I(ASL, Acc),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ORA, Abs),
-		I(ASL, Abs),
-		I(ILL, Ill),
-
-		I(BPL, Rel), // 0x10
-		I(ORA, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ORA, ZpX),
-		I(ASL, ZpX),
-		I(ILL, Ill),
-		I(CLC, Imp),
-		I(ORA, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ORA, AbX),
-		I(ASL, AbX),
-		I(ILL, Ill),
-
-		I(JSR, Abs), // 0x20
-		I(AND, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(BIT, ZoP),
-		I(AND, ZoP), 
-		I(ROL, ZoP), 
-		I(ILL, Ill), 
-		I(PLP, Imp), 
-		I(AND, Imm), 
-		I(ROL, Acc), 
-		I(ILL, Ill), 
-		I(BIT, Abs),
-		I(AND, Abs),
-		I(ROL, Abs),
-		I(ILL, Ill),
-
-		I(BMI, Rel), // 0x30
-		I(AND, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(AND, ZpX),
-		I(ROL, ZpX),
-		I(ILL, Ill),
-		I(SEC, Imp),
-		I(AND, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(AND, AbX),
-		I(ROL, AbX),
-		I(ILL, Ill),
-
-		I(RTI, Imp), // 0x40
-		I(EOR, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(EOR, ZoP),
-		I(LSR, ZoP),
-		I(ILL, Ill),
-		I(PHA, Imp),
-		I(EOR, Imm),
-		I(LSR, Acc),
-		I(ILL, Ill),
-		I(JMP, Abs),
-		I(EOR, Abs),
-		I(LSR, Abs),
-		I(ILL, Ill),
-
-		I(BVC, Rel), // 0x50
-		I(EOR, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(EOR, ZpX),
-		I(LSR, ZpX),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(EOR, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(EOR, AbX),
-		I(LSR, AbX),
-		I(ILL, Ill),
-
-		I(RTS, Imp), // 0x60
-		I(ADC, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ADC, ZoP),
-		I(ROR, ZoP),
-		I(ILL, Ill),
-		I(PLA, Imp),
-		I(ADC, Imm),
-		I(ROR, Acc),
-		I(ILL, Ill),
-		I(JMP, Ind),
-		I(ADC, Abs),
-		I(ROR, Abs),
-		I(ILL, Ill),
-
-		I(BVS, Rel), // 0x70
-		I(ADC, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ADC, ZpX),
-		I(ROR, ZpX),
-		I(ILL, Ill),
-		I(SEI, Imp),
-		I(ADC, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ADC, AbX),
-		I(ROR, AbX),
-		I(ILL, Ill),
-
-		I(ILL, Ill), // 0x80
-		I(STA, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(STY, ZoP),
-		I(STA, ZoP),
-		I(STX, ZoP),
-		I(ILL, Ill),
-		I(DEY, Imp),
-		I(ILL, Ill),
-		I(TXA, Imp),
-		I(ILL, Ill),
-		I(STY, Abs),
-		I(STA, Abs),
-		I(STX, Abs),
-		I(ILL, Ill),
-
-		I(BCC, Rel), // 0x90
-		I(STA, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(STY, ZpX),
-		I(STA, ZpX),
-		I(STX, ZpY),
-		I(ILL, Ill),
-		I(TYA, Imp),
-		I(STA, AbY),
-		I(TXS, Imp),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(STA, AbX),
-		I(ILL, Ill),
-		I(ILL, Ill),
-
-		I(LDY, Imm), // 0xA0
-		I(LDA, Pre),
-		I(LDX, Imm),
-		I(ILL, Ill),
-		I(LDY, ZoP),
-		I(LDA, ZoP),
-		I(LDX, ZoP),
-		I(ILL, Ill),
-		I(TAY, Imp),
-		I(LDA, Imm),
-		I(TAX, Imp),
-		I(ILL, Ill),
-		I(LDY, Abs),
-		I(LDA, Abs),
-		I(LDX, Abs),
-		I(ILL, Ill),
-
-		I(BCS, Rel), // 0xB0
-		I(LDA, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(LDY, ZpX),
-		I(LDA, ZpX),
-		I(LDX, ZpY),
-		I(ILL, Ill),
-		I(CLV, Imp),
-		I(LDA, AbY),
-		I(TSX, Imp),
-		I(ILL, Ill),
-		I(LDY, AbX),
-		I(LDA, AbX),
-		I(LDX, AbY),
-		I(ILL, Ill),
-
-		I(CPY, Imm), // 0xC0
-		I(CMP, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(CPY, ZoP),
-		I(CMP, ZoP),
-		I(DEC, ZoP),
-		I(ILL, Ill),
-		I(INY, Imp),
-		I(CMP, Imm),
-		I(DEX, Imp),
-		I(ILL, Ill),
-		I(CPY, Abs),
-		I(CMP, Abs),
-		I(DEC, Abs),
-		I(ILL, Ill),
-
-		I(BNE, Rel), // 0xD0
-		I(CMP, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(CMP, ZpX),
-		I(DEC, ZpX),
-		I(ILL, Ill),
-		I(CLD, Imp),
-		I(CMP, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(CMP, AbX),
-		I(DEC, AbX),
-		I(ILL, Ill),
-
-		I(CPX, Imm), // 0xE0
-		I(SBC, Pre),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(CPX, ZoP),
-		I(SBC, ZoP),
-		I(INC, ZoP),
-		I(ILL, Ill),
-		I(INX, Imp),
-		I(SBC, Imm),
-		I(NOP, Imp),
-		I(ILL, Ill),
-		I(CPX, Abs),
-		I(SBC, Abs),
-		I(INC, Abs),
-		I(ILL, Ill),
-
-		I(BEQ, Rel), // 0xF0
-		I(SBC, Pos),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(SBC, ZpX),
-		I(INC, ZpX),
-		I(ILL, Ill),
-		I(SED, Imp),
-		I(SBC, AbY),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(ILL, Ill),
-		I(SBC, AbX),
-		I(INC, AbX),
-		I(ILL, Ill),
+		std::vector<DecodedInstruction> m_instructions;
+		uint16_t m_pc{0};
+		uint32_t m_maxCycles{0};
+
+		// Successors within the same page, which are mapped to the same bank as the block itself.
+		// nullptr if unused.
+		mutable std::array<std::atomic<const Block*>, 2> m_links{};
+	};
+
+	static constexpr size_t maxBlockLength{32};
+	// Marks the offsets where no block can start
+	static const Block unbuildable;
+
+	// Everything decoded from the ROM. It only depends on the ROM, so CPUs running the same ROM
+	// can share it, also on different threads. Entries are only ever filled, never changed or
+	// moved: CPUs decoding the same entry at once get the same result, and the first one stored
+	// is kept.
+	struct DecodeCache
+	{
+		explicit DecodeCache(size_t romSize);
+		~DecodeCache();
+		DecodeCache(const DecodeCache&) = delete;
+		DecodeCache& operator=(const DecodeCache&) = delete;
+
+		// By PRG-ROM offset: decodedFlag | operand << 8 | opcode, 0 if not decoded yet. One word,
+		// so an entry is always read whole.
+		std::vector<std::atomic<uint32_t>> m_instructions;
+		// By PRG-ROM offset: the block starting there, nullptr if not built yet
+		std::vector<std::atomic<const Block*>> m_blocks;
 	};
+	NonNullSharedPtr<DecodeCache> m_decodeCache;
+	static constexpr uint32_t decodedFlag{0x1000000};
+
+	const Block* findBlock();
+	const Block* nextBlock(const Block& previous);
+	// nullptr if not even the first instruction fits into a block
+	std::unique_ptr<Block> buildBlock();
+	static bool isConfined(const Instruction& instruction, uint16_t operand);
+	uint32_t runBlock(const Block& block
+#if defined(LIBMOS6502_LOG)
+		, std::ofstream& log
+#endif
+	);
 };
 
+using VirtualMos6502 = Mos6502<Memory>;
+
+extern template class Mos6502<Memory>;
+
 }
 
+#include "libmos6502/mos6502_impl.h"
+
 #endif // MOS6502_H
@@ -0,0 +1,1475 @@
+#ifndef MOS6502_IMPL_H
+#define MOS6502_IMPL_H
+
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+
+#include "libmos6502/mos6502.h"
+
+namespace LibMos6502
+{
+
+template<typename Bus>
+Mos6502<Bus>::Mos6502(NonNullSharedPtr<Bus> memory) :
+	m_memory{memory},
+	m_pc{pcDefault}, 
+	m_sp{spDefault}, 
+	m_acc{accDefault}, 
+	m_x{xDefault}, 
+	m_y{yDefault}, 
+	m_flags{0},
+	m_carry{false},
+	m_negativeResult{0},
+	m_zeroResult{0},
+	m_overflowLhs{0},
+	m_overflowRhs{0},
+	m_overflowResult{0},
+	m_cycles{0}, 
+	m_cycleCount{0},
+	m_cycleBalance{0},
+	m_stopRequested{false},
+	m_nmiPending{false},
+	m_newPc{0},
+	m_operand{0},
+	m_decodeCache{makeNonNullShared<DecodeCache>(0)}
+{
+
+}
+
+template<typename Bus>
+void Mos6502<Bus>::reset()
+{
+	m_sp = spDefault;
+	m_acc = accDefault;
+	m_x = xDefault;
+	m_y = yDefault;
+	setStatus(statusDefault);
+	m_pc = read16(resetVector);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::step(
+#if defined(LIBMOS6502_LOG)
+	std::ofstream& log
+#endif
+)
+{
+	m_cycles = 0;
+
+	const size_t romOffset{m_memory->romOffset(m_pc)};
+	const bool cacheable{romOffset < m_decodeCache->m_instructions.size()};
+	const uint32_t decoded{cacheable ? m_decodeCache->m_instructions[romOffset].load(std::memory_order_relaxed) : 0};
+
+	if (m_nmiPending)
+	{
+#if defined(LIBMOS6502_LOG)
+		log << "NMI";
+#endif
+		m_nmiPending = false;
+		m_cycles = 2; // opcode fetches are discarded
+		interrupt(nmiVector, m_pc, false);
+	}
+	else if (decoded & decodedFlag)
+	{
+		const uint8_t opCode{static_cast<uint8_t>(decoded)};
+		m_operand = static_cast<uint16_t>(decoded >> 8);
+#if defined(LIBMOS6502_LOG)
+		writeLog(log, opCode);
+#endif
+		instructions[opCode].m_handler(*this);
+	}
+	else
+	{
+		const uint8_t opCode{read8(m_pc)};
+		const Instruction& instruction{instructions[opCode]};
+#if defined(LIBMOS6502_LOG)
+		writeLog(log, opCode);
+#endif
+		instruction.m_fetchHandler(*this);
+
+		// Instructions crossing a page are not cached: the next page may be remapped to another bank.
+		if (cacheable && (m_pc & 0xFF) + instruction.m_length <= 0x100)
+		{
+			m_decodeCache->m_instructions[romOffset].store(decodedFlag | static_cast<uint32_t>(m_operand) << 8 | opCode,
+				std::memory_order_relaxed);
+		}
+	}
+
+	m_cycles += m_cycles == 1;
+	m_cycleCount += m_cycles;
+
+	m_pc = m_newPc;
+}
+
+#if defined(LIBMOS6502_LOG)
+template<typename Bus>
+void Mos6502<Bus>::writeLog(std::ofstream& log, uint8_t opCode)
+{
+	log << std::hex << std::setfill('0') << std::setw(4) << std::right << std::uppercase << 
+		m_pc << " " << std::setw(2) << static_cast<int>(opCode) << " " <<
+		instructions[opCode].m_name << " " <<
+		"A:" << std::setw(2) << static_cast<int>(m_acc) << " " << 
+		"X:" << std::setw(2) << static_cast<int>(m_x) << " " << 
+		"Y:" << std::setw(2) << static_cast<int>(m_y) << " " << 
+		"P:" << std::setw(2) << (getStatus() & 0xEF) << " " << 
+		"SP:" << std::setw(2) << static_cast<int>(m_sp);
+}
+#endif
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::getCycles()
+{
+	return m_cycles;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::flushDecodeCache()
+{
+	// A new cache, CPUs sharing the old one keep it
+	m_decodeCache = makeNonNullShared<DecodeCache>(m_memory->romSize());
+}
+
+template<typename Bus>
+const typename Mos6502<Bus>::Block Mos6502<Bus>::unbuildable{};
+
+template<typename Bus>
+Mos6502<Bus>::DecodeCache::DecodeCache(size_t romSize) :
+	m_instructions(romSize),
+	m_blocks(romSize)
+{
+
+}
+
+template<typename Bus>
+Mos6502<Bus>::DecodeCache::~DecodeCache()
+{
+	for (const std::atomic<const Block*>& block : m_blocks)
+	{
+		if (block != &unbuildable)
+		{
+			delete block.load();
+		}
+	}
+}
+
+template<typename Bus>
+void Mos6502<Bus>::shareDecodeCache(const Mos6502& other)
+{
+	m_decodeCache = other.m_decodeCache;
+}
+
+template<typename Bus>
+typename Mos6502<Bus>::State Mos6502<Bus>::getState() const
+{
+	// Zero initialized first, so the padding is the same in every copy
+	State state{};
+	state.m_cycleCount = m_cycleCount;
+	state.m_cycleBalance = m_cycleBalance;
+	state.m_pc = m_pc;
+	state.m_sp = m_sp;
+	state.m_acc = m_acc;
+	state.m_x = m_x;
+	state.m_y = m_y;
+	state.m_status = getStatus();
+	state.m_cycles = m_cycles;
+	state.m_nmiPending = m_nmiPending;
+	return state;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::setState(const State& state)
+{
+	m_cycleCount = state.m_cycleCount;
+	m_cycleBalance = state.m_cycleBalance;
+	m_pc = state.m_pc;
+	m_sp = state.m_sp;
+	m_acc = state.m_acc;
+	m_x = state.m_x;
+	m_y = state.m_y;
+	setStatus(state.m_status);
+	m_cycles = state.m_cycles;
+	m_nmiPending = state.m_nmiPending;
+	m_stopRequested = false;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::nmi()
+{
+	m_nmiPending = true;
+}
+
+template<typename Bus>
+uint64_t Mos6502<Bus>::getCycleCount()
+{
+	return m_cycleCount;
+}
+
+template<typename Bus>
+uint64_t Mos6502<Bus>::getCurrentCycle()
+{
+	return m_cycleCount + m_cycles;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::stall(uint16_t cycles)
+{
+	m_cycleCount += cycles;
+	m_cycleBalance -= cycles;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::interrupt(uint16_t vector, uint16_t returnAddress, bool brk)
+{
+	push16(returnAddress);
+	push8((getStatus() & 0xCF) | (brk ? 0x30 : 0x20));
+	m_flags |= StatusFlags::Interrupt;
+	m_newPc = read16(vector);
+}
+
+template<typename Bus>
+uint32_t Mos6502<Bus>::run(uint32_t cycleBudget
+#if defined(LIBMOS6502_LOG)
+	, std::ofstream& log
+#endif
+)
+{
+	m_cycleBalance += cycleBudget;
+
+	const uint64_t start{m_cycleCount};
+	while (m_cycleBalance > 0 && !m_stopRequested)
+	{
+#if defined(LIBMOS6502_LOG)
+		step(log);
+		log << "\n";
+		m_cycleBalance -= m_cycles;
+#else
+		m_cycleBalance -= stepBlock(static_cast<uint32_t>(m_cycleBalance));
+#endif
+	}
+
+	m_stopRequested = false;
+	return static_cast<uint32_t>(m_cycleCount - start);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::requestStop()
+{
+	m_stopRequested = true;
+}
+
+template<typename Bus>
+int64_t Mos6502<Bus>::getCycleBalance()
+{
+	return m_cycleBalance;
+}
+
+template<typename Bus>
+uint32_t Mos6502<Bus>::stepBlock(uint32_t maxCycles
+#if defined(LIBMOS6502_LOG)
+	, std::ofstream& log
+#endif
+)
+{
+	const Block* block{m_nmiPending ? nullptr : findBlock()};
+	if (!block || block->m_maxCycles > maxCycles)
+	{
+		step(
+#if defined(LIBMOS6502_LOG)
+			log
+#endif
+		);
+		return m_cycles;
+	}
+
+	uint32_t cycles{0};
+	do
+	{
+		cycles += runBlock(*block
+#if defined(LIBMOS6502_LOG)
+			, log
+#endif
+		);
+		block = nextBlock(*block);
+	} while (block && cycles + block->m_maxCycles <= maxCycles);
+
+	return cycles;
+}
+
+template<typename Bus>
+uint32_t Mos6502<Bus>::runBlock(const Block& block
+#if defined(LIBMOS6502_LOG)
+	, std::ofstream& log
+#endif
+)
+{
+	uint32_t cycles{0};
+	for (const DecodedInstruction& instruction : block.m_instructions)
+	{
+		m_cycles = 0;
+		m_operand = instruction.m_operand;
+#if defined(LIBMOS6502_LOG)
+		writeLog(log, instruction.m_opCode);
+		log << "\n";
+#endif
+		instruction.m_handler(*this);
+		m_cycles += m_cycles == 1;
+		cycles += m_cycles;
+		m_pc = m_newPc;
+	}
+	m_cycleCount += cycles;
+	return cycles;
+}
+
+template<typename Bus>
+const typename Mos6502<Bus>::Block* Mos6502<Bus>::findBlock()
+{
+	const size_t romOffset{m_memory->romOffset(m_pc)};
+	if (romOffset >= m_decodeCache->m_blocks.size())
+	{
+		return nullptr;
+	}
+
+	std::atomic<const Block*>& slot{m_decodeCache->m_blocks[romOffset]};
+	const Block* block{slot.load(std::memory_order_acquire)};
+	if (!block)
+	{
+		// Another CPU sharing the cache may build the same block meanwhile, the first one stored wins
+		std::unique_ptr<Block> built{buildBlock()};
+		const Block* const expected{built ? built.get() : &unbuildable};
+		if (slot.compare_exchange_strong(block, expected, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			block = expected;
+			static_cast<void>(built.release()); // owned by the cache now
+		}
+	}
+	return block == &unbuildable ? nullptr : block;
+}
+
+template<typename Bus>
+const typename Mos6502<Bus>::Block* Mos6502<Bus>::nextBlock(const Block& previous)
+{
+	if ((m_pc & 0xFF00) != (previous.m_pc & 0xFF00))
+	{
+		return findBlock();
+	}
+
+	for (const std::atomic<const Block*>& link : previous.m_links)
+	{
+		const Block* const block{link.load(std::memory_order_acquire)};
+		if (block && block->m_pc == m_pc)
+		{
+			return block;
+		}
+	}
+
+	const Block* const next{findBlock()};
+	if (next)
+	{
+		for (std::atomic<const Block*>& link : previous.m_links)
+		{
+			const Block* expected{nullptr};
+			if (link.compare_exchange_strong(expected, next, std::memory_order_release, std::memory_order_relaxed) ||
+				expected == next)
+			{
+				break;
+			}
+		}
+	}
+	return next;
+}
+
+template<typename Bus>
+std::unique_ptr<typename Mos6502<Bus>::Block> Mos6502<Bus>::buildBlock()
+{
+	std::unique_ptr<Block> block{std::make_unique<Block>()};
+	block->m_pc = m_pc;
+
+	for (uint16_t pc{m_pc}; block->m_instructions.size() < maxBlockLength;)
+	{
+		// Reading ROM has no side effects, so the bus can be accessed directly
+		const uint8_t opCode{m_memory->read(pc)};
+		const Instruction& instruction{instructions[opCode]};
+		if ((pc & 0xFF) + instruction.m_length > 0x100)
+		{
+			break;
+		}
+
+		uint16_t operand{0};
+		if (instruction.m_length == 2)
+		{
+			operand = m_memory->read(pc + 1);
+		}
+		else if (instruction.m_length == 3)
+		{
+			operand = (m_memory->read(pc + 2) << 8) | m_memory->read(pc + 1);
+		}
+
+		if (!isConfined(instruction, operand))
+		{
+			break;
+		}
+
+		block->m_instructions.push_back({instruction.m_handler, operand, opCode});
+		block->m_maxCycles += instruction.m_cycles + getPenalty(instruction.m_addressMode);
+		pc += instruction.m_length;
+
+		if (instruction.m_controlFlow)
+		{
+			break;
+		}
+	}
+
+	if (block->m_instructions.empty())
+	{
+		return nullptr;
+	}
+	return block;
+}
+
+template<typename Bus>
+bool Mos6502<Bus>::isConfined(const Instruction& instruction, uint16_t operand)
+{
+	constexpr uint16_t ramEnd{0x2000};
+	constexpr uint16_t cartridgeStart{0x4020};
+
+	switch (instruction.m_addressMode)
+	{
+	case AddressMode::Abs:
+		// Jumps don't access their operand
+		return instruction.m_controlFlow || operand < ramEnd;
+	case AddressMode::AbX:
+	case AddressMode::AbY:
+		return operand + 0xFF < ramEnd;
+	case AddressMode::Ind:
+		// Only reads the pointer
+		return operand + 1 < ramEnd || (operand >= cartridgeStart && operand != 0xFFFF);
+	case AddressMode::Pre:
+	case AddressMode::Pos:
+		return false;
+	default:
+		return true;
+	}
+}
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::read8(uint16_t addr)
+{
+	++m_cycles;
+	return m_memory->read(addr);
+}
+
+template<typename Bus>
+uint16_t Mos6502<Bus>::read16(uint16_t addr)
+{
+	return (read8(addr + 1) << 8) | read8(addr);
+}
+
+template<typename Bus>
+uint16_t Mos6502<Bus>::readPage16(uint16_t addr)
+{
+	return (read8((addr + 1) & 0xFF) << 8) | read8(addr);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::fetchOperand()
+{
+	if constexpr (getLength(mode) == 2)
+	{
+		m_operand = read8(m_pc + 1);
+	}
+	else if constexpr (getLength(mode) == 3)
+	{
+		m_operand = read16(m_pc + 1);
+	}
+	m_newPc = m_pc + getLength(mode);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::write8(uint16_t addr, uint8_t data)
+{
+	++m_cycles;
+	m_memory->write(addr, data);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::push8(uint8_t data)
+{
+	write8(stackOffset + m_sp--, data);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::push16(uint16_t data)
+{
+	push8(data >> 8);
+	push8(data & 0xFF);
+}
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::pull8()
+{
+	return read8(stackOffset + ++m_sp);
+}
+
+template<typename Bus>
+uint16_t Mos6502<Bus>::pull16()
+{
+	uint16_t data{pull8()};
+	data |= pull8() << 8;
+	return data;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::pullStatus()
+{
+	setStatus((pull8() & 0xCF) | (m_flags & 0x30));
+}
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::getStatus() const
+{
+	return m_flags | 
+		(m_negativeResult & StatusFlags::Negative) | 
+		(getOverflow() ? StatusFlags::Overflow : 0) |
+		(m_zeroResult == 0 ? StatusFlags::Zero : 0) | 
+		(m_carry ? StatusFlags::Carry : 0);
+}
+
+template<typename Bus>
+void Mos6502<Bus>::setStatus(uint8_t status)
+{
+	m_flags = status & ~(StatusFlags::Negative | StatusFlags::Overflow | StatusFlags::Zero | StatusFlags::Carry);
+	m_negativeResult = status;
+	m_zeroResult = ~status & StatusFlags::Zero;
+	m_carry = status & StatusFlags::Carry;
+	setOverflow(status & StatusFlags::Overflow);
+}
+
+template<typename Bus>
+bool Mos6502<Bus>::getOverflow() const
+{
+	// Both operands had the same sign AND the result has a different sign
+	return ~(m_overflowLhs ^ m_overflowRhs) & (m_overflowLhs ^ m_overflowResult) & 0x80;
+}
+
+template<typename Bus>
+void Mos6502<Bus>::setOverflow(bool overflow)
+{
+	m_overflowLhs = 0;
+	m_overflowRhs = 0;
+	m_overflowResult = overflow ? 0x80 : 0;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+uint16_t Mos6502<Bus>::readAddress(bool assumePageCross)
+{
+	uint16_t addr{0};
+
+	if constexpr (mode == AddressMode::Abs || mode == AddressMode::ZoP)
+	{
+		addr = m_operand;
+	}
+
+	else if constexpr (mode == AddressMode::ZpX)
+	{
+		++m_cycles;
+		addr = (m_operand + m_x) & 0xFF;
+	}
+
+	else if constexpr (mode == AddressMode::ZpY)
+	{
+		++m_cycles;
+		addr = (m_operand + m_y) & 0xFF;
+	}
+
+	else if constexpr (mode == AddressMode::AbX)
+	{
+		addr = m_operand;
+		if ((((addr & 0xFF) + m_x) & 0xFF00) != 0 || assumePageCross)
+		{
+			++m_cycles;
+		}
+		addr += m_x;
+	}
+
+	else if constexpr (mode == AddressMode::AbY)
+	{
+		addr = m_operand;
+		if ((((addr & 0xFF) + m_y) & 0xFF00) != 0 || assumePageCross)
+		{
+			++m_cycles;
+		}
+		addr += m_y;
+	}
+
+	else if constexpr (mode == AddressMode::Pre)
+	{
+		++m_cycles; // due to post increment
+		addr = (m_operand + m_x) & 0xFF;
+		addr = readPage16(addr);
+	}
+
+	else if constexpr (mode == AddressMode::Pos)
+	{
+		addr = readPage16(m_operand);
+		if ((((addr & 0xFF) + m_y) & 0xFF00) != 0 || assumePageCross)
+		{
+			++m_cycles;
+		}
+		addr += m_y;
+	}
+
+	else if constexpr (mode == AddressMode::Ind)
+	{
+		addr = m_operand;
+		// 6502 fetches incorrectly if address is at page boundary
+		if ((addr & 0xFF) == 0xFF)
+		{
+			addr = (read8(addr & 0xFF00) << 8) | read8(addr);
+		}
+		else
+		{
+			addr = read16(addr);
+		}
+	}
+
+	return addr;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+uint8_t Mos6502<Bus>::readValue()
+{
+	if constexpr (mode == AddressMode::Imm || mode == AddressMode::Rel)
+	{
+		return static_cast<uint8_t>(m_operand); // fetched along with the opcode
+	}
+	else
+	{
+		return read8(readAddress<mode>());
+	}
+}
+
+template<typename Bus>
+void Mos6502<Bus>::setNZ(uint8_t src)
+{
+	m_negativeResult = src;
+	m_zeroResult = src;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ADC()
+{
+	const uint8_t accOld{m_acc};
+	const uint8_t src{readValue<mode>()};
+	const auto sum{static_cast<uint16_t>(m_acc + src + m_carry)};
+	m_acc = sum & 0xFF;
+
+	m_carry = sum >= 0x100;
+	setNZ(m_acc);
+	m_overflowLhs = accOld;
+	m_overflowRhs = src;
+	m_overflowResult = m_acc;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::SBC()
+{
+	const uint8_t accOld{m_acc};
+	const uint8_t src{readValue<mode>()};
+	const uint16_t dif{static_cast<uint16_t>(m_acc - src - !m_carry)};
+	m_acc = dif & 0xFF;
+
+	m_carry = dif < 0x100;
+	setNZ(m_acc);
+	m_overflowLhs = accOld;
+	m_overflowRhs = ~src; // subtraction adds the complement
+	m_overflowResult = m_acc;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::AND()
+{
+	m_acc &= readValue<mode>();
+	setNZ(m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ASL()
+{
+	if constexpr (mode == AddressMode::Acc)
+	{
+		m_carry = m_acc & 0x80;
+		m_acc <<= 1;
+		setNZ(m_acc);
+	}
+	else
+	{
+		const uint16_t addr{readAddress<mode>(true)};
+		uint8_t src{read8(addr)};
+		m_carry = src & 0x80;
+		++m_cycles; // rmw instructions take one extra cycle during modify
+		write8(addr, src <<= 1);
+		setNZ(src);
+	}
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BIT()
+{
+	const uint8_t src{readValue<mode>()};
+	m_negativeResult = src;
+	setOverflow(src & 0x40);
+	m_zeroResult = src & m_acc;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BRK()
+{
+	++m_cycles; // padding byte after the opcode
+	interrupt(irqVector, m_pc + 2, true);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::compare(uint8_t reg)
+{
+	const uint8_t src{readValue<mode>()};
+	m_carry = reg >= src;
+	setNZ(reg - src);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CMP()
+{
+	compare<mode>(m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CPX()
+{
+	compare<mode>(m_x);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CPY()
+{
+	compare<mode>(m_y);
+}
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::decrement(uint8_t src)
+{
+	++m_cycles; // rmw instructions take one extra cycle during modify
+	setNZ(--src);
+	return src;
+}
+
+template<typename Bus>
+uint8_t Mos6502<Bus>::increment(uint8_t src)
+{
+	++m_cycles; // rmw instructions take one extra cycle during modify
+	setNZ(++src);
+	return src;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::DEC()
+{
+	const uint16_t addr{readAddress<mode>(true)};
+	write8(addr, decrement(read8(addr)));
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::DEX()
+{
+	m_x = decrement(m_x);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::DEY()
+{
+	m_y = decrement(m_y);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::INC()
+{
+	const uint16_t addr{readAddress<mode>(true)};
+	write8(addr, increment(read8(addr)));
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::INX()
+{
+	m_x = increment(m_x);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::INY()
+{
+	m_y = increment(m_y);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::EOR()
+{
+	setNZ(m_acc ^= readValue<mode>());
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::JMP()
+{
+	m_newPc = readAddress<mode>();
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::JSR()
+{
+	++m_cycles; // Due to stack push
+	push16(m_pc + 2);
+	m_newPc = readAddress<mode>();
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::LSR()
+{
+	if constexpr (mode == AddressMode::Acc)
+	{
+		m_carry = m_acc & 0x01;
+		m_acc >>= 1;
+		m_zeroResult = m_acc;
+	}
+	else
+	{
+		const uint16_t addr{readAddress<mode>(true)};
+		uint8_t src{read8(addr)};
+		m_carry = src & 0x01;
+		++m_cycles; // rmw instructions take one extra cycle during modify
+		write8(addr, src >>= 1);
+		m_zeroResult = src;
+	}
+	m_negativeResult = 0;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::NOP()
+{
+	// TODO: Prove Riemann's Hypothesis
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ORA()
+{
+	m_acc |= readValue<mode>();
+	setNZ(m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ROL()
+{
+	if constexpr (mode == AddressMode::Acc)
+	{
+		const bool oldCarry{m_carry};
+		m_carry = m_acc & 0x80;
+		m_acc = (m_acc << 1) | static_cast<uint8_t>(oldCarry);
+		setNZ(m_acc);
+	}
+	else
+	{
+		const uint16_t addr{readAddress<mode>(true)};
+		uint8_t src{read8(addr)};
+		const bool oldCarry{m_carry};
+		m_carry = src & 0x80;
+		++m_cycles; // rmw instructions take one extra cycle during modify
+		write8(addr, src = (src << 1) | static_cast<uint8_t>(oldCarry));
+		setNZ(src);
+	}
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ROR()
+{
+	if constexpr (mode == AddressMode::Acc)
+	{
+		const bool oldCarry{m_carry};
+		m_carry = m_acc & 0x01;
+		m_acc = (m_acc >> 1) | (static_cast<uint8_t>(oldCarry) << 7);
+		setNZ(m_acc);
+	}
+	else
+	{
+		const uint16_t addr{readAddress<mode>(true)};
+		uint8_t src{read8(addr)};
+		const bool oldCarry{m_carry};
+		m_carry = src & 0x01;
+		++m_cycles; // rmw instructions take one extra cycle during modify
+		write8(addr, src = (src >> 1) | (static_cast<uint8_t>(oldCarry) << 7));
+		setNZ(src);
+	}
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::RTI()
+{
+	m_cycles += 2; // stack pull
+	pullStatus();
+	m_newPc = pull16();
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::RTS()
+{
+	m_cycles += 2 + 1; // stack pull + post increment of the pc
+	m_newPc = pull16() + 1;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TAX()
+{
+	setNZ(m_x = m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TAY()
+{
+	setNZ(m_y = m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TSX()
+{
+	setNZ(m_x = m_sp);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TXA()
+{
+	setNZ(m_acc = m_x);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TXS()
+{
+	m_sp = m_x;
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::TYA()
+{
+	setNZ(m_acc = m_y);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::STA()
+{
+	write8(readAddress<mode>(true), m_acc);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::STX()
+{
+	write8(readAddress<mode>(), m_x);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::STY()
+{
+	write8(readAddress<mode>(), m_y);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::SEC()
+{
+	m_carry = true;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::SED()
+{
+	m_flags |= StatusFlags::Decimal;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::SEI()
+{
+	m_flags |= StatusFlags::Interrupt;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CLC()
+{
+	m_carry = false;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CLD()
+{
+	m_flags &= ~StatusFlags::Decimal;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CLI()
+{
+	m_flags &= ~StatusFlags::Interrupt;
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::CLV()
+{
+	setOverflow(false);
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::branch(bool condition)
+{
+	if (condition)
+	{
+		++m_cycles;
+		const uint16_t oldPc{m_pc};
+		m_newPc += static_cast<int8_t>(readValue<mode>()); // offset is signed
+		m_cycles += ((oldPc + 2) & 0xFF00) != (m_newPc & 0xFF00);
+	}
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BCC()
+{
+	branch<mode>(!m_carry);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BCS()
+{
+	branch<mode>(m_carry);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BEQ()
+{
+	branch<mode>(m_zeroResult == 0);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BMI()
+{
+	branch<mode>(m_negativeResult & StatusFlags::Negative);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BNE()
+{
+	branch<mode>(m_zeroResult != 0);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BPL()
+{
+	branch<mode>(!(m_negativeResult & StatusFlags::Negative));
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BVC()
+{
+	branch<mode>(!getOverflow());
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::BVS()
+{
+	branch<mode>(getOverflow());
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::LDA()
+{
+	setNZ(m_acc = readValue<mode>());
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::LDX()
+{
+	setNZ(m_x = readValue<mode>());
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::LDY()
+{
+	setNZ(m_y = readValue<mode>());
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::PHA()
+{
+	++m_cycles; // stack push
+	push8(m_acc);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::PHP()
+{
+	++m_cycles; // stack push
+	push8(getStatus() | 0x30);
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::PLA()
+{
+	m_cycles += 2; // stack pull
+	setNZ(m_acc = pull8());
+}
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::PLP()
+{
+	m_cycles += 2; // stack pull
+	pullStatus();
+}
+
+template<typename Bus>
+template<typename Mos6502<Bus>::AddressMode mode>
+void Mos6502<Bus>::ILL()
+{
+	// TODO: Call the police.
+}
+
+#if defined(LIBMOS6502_LOG)
+#define I(instruction, addressMode, cycles) { \
+	&Mos6502::execute<&Mos6502::instruction<AddressMode::addressMode>, AddressMode::addressMode>, \
+	&Mos6502::fetchAndExecute<&Mos6502::instruction<AddressMode::addressMode>, AddressMode::addressMode>, \
+	AddressMode::addressMode, \
+	getLength(AddressMode::addressMode), \
+	cycles, \
+	isControlFlow(#instruction, AddressMode::addressMode), \
+	#instruction }
+#else
+#define I(instruction, addressMode, cycles) { \
+	&Mos6502::execute<&Mos6502::instruction<AddressMode::addressMode>, AddressMode::addressMode>, \
+	&Mos6502::fetchAndExecute<&Mos6502::instruction<AddressMode::addressMode>, AddressMode::addressMode>, \
+	AddressMode::addressMode, \
+	getLength(AddressMode::addressMode), \
+	cycles, \
+	isControlFlow(#instruction, AddressMode::addressMode) }
+#endif // defined(LIBMOS6502_LOG)
+
+template<typename Bus>
+const std::array<typename Mos6502<Bus>::Instruction, 256> Mos6502<Bus>::instructions
+{{
+	I(BRK, Imp, 7), // 0x00
+	I(ORA, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ORA, ZoP, 3),
+	I(ASL, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(PHP, Imp, 3),
+	I(ORA, Imm, 2),
+	I(ASL, Acc, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ORA, Abs, 4),
+	I(ASL, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BPL, Rel, 2), // 0x10
+	I(ORA, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ORA, ZpX, 4),
+	I(ASL, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(CLC, Imp, 2),
+	I(ORA, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ORA, AbX, 4),
+	I(ASL, AbX, 7),
+	I(ILL, Ill, 2),
+
+	I(JSR, Abs, 6), // 0x20
+	I(AND, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(BIT, ZoP, 3),
+	I(AND, ZoP, 3),
+	I(ROL, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(PLP, Imp, 4),
+	I(AND, Imm, 2),
+	I(ROL, Acc, 2),
+	I(ILL, Ill, 2),
+	I(BIT, Abs, 4),
+	I(AND, Abs, 4),
+	I(ROL, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BMI, Rel, 2), // 0x30
+	I(AND, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(AND, ZpX, 4),
+	I(ROL, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(SEC, Imp, 2),
+	I(AND, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(AND, AbX, 4),
+	I(ROL, AbX, 7),
+	I(ILL, Ill, 2),
+
+	I(RTI, Imp, 6), // 0x40
+	I(EOR, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(EOR, ZoP, 3),
+	I(LSR, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(PHA, Imp, 3),
+	I(EOR, Imm, 2),
+	I(LSR, Acc, 2),
+	I(ILL, Ill, 2),
+	I(JMP, Abs, 3),
+	I(EOR, Abs, 4),
+	I(LSR, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BVC, Rel, 2), // 0x50
+	I(EOR, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(EOR, ZpX, 4),
+	I(LSR, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(CLI, Imp, 2),
+	I(EOR, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(EOR, AbX, 4),
+	I(LSR, AbX, 7),
+	I(ILL, Ill, 2),
+
+	I(RTS, Imp, 6), // 0x60
+	I(ADC, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ADC, ZoP, 3),
+	I(ROR, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(PLA, Imp, 4),
+	I(ADC, Imm, 2),
+	I(ROR, Acc, 2),
+	I(ILL, Ill, 2),
+	I(JMP, Ind, 5),
+	I(ADC, Abs, 4),
+	I(ROR, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BVS, Rel, 2), // 0x70
+	I(ADC, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ADC, ZpX, 4),
+	I(ROR, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(SEI, Imp, 2),
+	I(ADC, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ADC, AbX, 4),
+	I(ROR, AbX, 7),
+	I(ILL, Ill, 2),
+
+	I(ILL, Ill, 2), // 0x80
+	I(STA, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(STY, ZoP, 3),
+	I(STA, ZoP, 3),
+	I(STX, ZoP, 3),
+	I(ILL, Ill, 2),
+	I(DEY, Imp, 2),
+	I(ILL, Ill, 2),
+	I(TXA, Imp, 2),
+	I(ILL, Ill, 2),
+	I(STY, Abs, 4),
+	I(STA, Abs, 4),
+	I(STX, Abs, 4),
+	I(ILL, Ill, 2),
+
+	I(BCC, Rel, 2), // 0x90
+	I(STA, Pos, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(STY, ZpX, 4),
+	I(STA, ZpX, 4),
+	I(STX, ZpY, 4),
+	I(ILL, Ill, 2),
+	I(TYA, Imp, 2),
+	I(STA, AbY, 5),
+	I(TXS, Imp, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(STA, AbX, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+
+	I(LDY, Imm, 2), // 0xA0
+	I(LDA, Pre, 6),
+	I(LDX, Imm, 2),
+	I(ILL, Ill, 2),
+	I(LDY, ZoP, 3),
+	I(LDA, ZoP, 3),
+	I(LDX, ZoP, 3),
+	I(ILL, Ill, 2),
+	I(TAY, Imp, 2),
+	I(LDA, Imm, 2),
+	I(TAX, Imp, 2),
+	I(ILL, Ill, 2),
+	I(LDY, Abs, 4),
+	I(LDA, Abs, 4),
+	I(LDX, Abs, 4),
+	I(ILL, Ill, 2),
+
+	I(BCS, Rel, 2), // 0xB0
+	I(LDA, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(LDY, ZpX, 4),
+	I(LDA, ZpX, 4),
+	I(LDX, ZpY, 4),
+	I(ILL, Ill, 2),
+	I(CLV, Imp, 2),
+	I(LDA, AbY, 4),
+	I(TSX, Imp, 2),
+	I(ILL, Ill, 2),
+	I(LDY, AbX, 4),
+	I(LDA, AbX, 4),
+	I(LDX, AbY, 4),
+	I(ILL, Ill, 2),
+
+	I(CPY, Imm, 2), // 0xC0
+	I(CMP, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(CPY, ZoP, 3),
+	I(CMP, ZoP, 3),
+	I(DEC, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(INY, Imp, 2),
+	I(CMP, Imm, 2),
+	I(DEX, Imp, 2),
+	I(ILL, Ill, 2),
+	I(CPY, Abs, 4),
+	I(CMP, Abs, 4),
+	I(DEC, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BNE, Rel, 2), // 0xD0
+	I(CMP, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(CMP, ZpX, 4),
+	I(DEC, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(CLD, Imp, 2),
+	I(CMP, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(CMP, AbX, 4),
+	I(DEC, AbX, 7),
+	I(ILL, Ill, 2),
+
+	I(CPX, Imm, 2), // 0xE0
+	I(SBC, Pre, 6),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(CPX, ZoP, 3),
+	I(SBC, ZoP, 3),
+	I(INC, ZoP, 5),
+	I(ILL, Ill, 2),
+	I(INX, Imp, 2),
+	I(SBC, Imm, 2),
+	I(NOP, Imp, 2),
+	I(ILL, Ill, 2),
+	I(CPX, Abs, 4),
+	I(SBC, Abs, 4),
+	I(INC, Abs, 6),
+	I(ILL, Ill, 2),
+
+	I(BEQ, Rel, 2), // 0xF0
+	I(SBC, Pos, 5),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(SBC, ZpX, 4),
+	I(INC, ZpX, 6),
+	I(ILL, Ill, 2),
+	I(SED, Imp, 2),
+	I(SBC, AbY, 4),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(ILL, Ill, 2),
+	I(SBC, AbX, 4),
+	I(INC, AbX, 7),
+	I(ILL, Ill, 2),
+}};
+#undef I
+
+}
+
+#endif // MOS6502_IMPL_H
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "libmos6502/mos6502.h"
+#include "reference_cpu.h"
+#include "test_bus.h"
+
+using namespace LibMos6502;
+using namespace LibMos6502::Test;
+
+namespace
+{
+
+constexpr uint64_t cyclesPerRun{30'000'000};
+// One NTSC frame, the budget the NES gives the CPU between scheduler events
+constexpr uint32_t cycleBudget{29781};
+
+#if defined(LIBMOS6502_LOG)
+std::ofstream log;
+#endif
+
+// Loads the PRG-ROM of an iNES file at 0x8000, a 16 KiB one mirrored at 0xC000 as NROM does
+bool loadINes(const std::string& path, std::array<uint8_t, 0x10000>& memory)
+{
+	std::ifstream file{path, std::ios::binary};
+	const std::vector<uint8_t> data{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+	if (data.size() < 16 || data[0] != 'N' || data[1] != 'E' || data[2] != 'S' || data[3] != 0x1A)
+	{
+		return false;
+	}
+
+	const size_t prgSize{data[4] * size_t{0x4000}};
+	const size_t prgStart{16 + ((data[6] & 0x04) ? size_t{512} : 0)};
+	if (prgSize == 0 || prgSize > 0x8000 || data.size() < prgStart + prgSize)
+	{
+		return false;
+	}
+	for (size_t address{0}; address < 0x8000; ++address)
+	{
+		memory[0x8000 + address] = data[prgStart + address % prgSize];
+	}
+	return true;
+}
+
+void report(const std::string& variant, uint64_t cycles, double seconds, double instructionsPerCycle)
+{
+	std::cout << std::left << std::setw(28) << variant << std::right << std::fixed << std::setprecision(1) <<
+		std::setw(10) << cycles / seconds / 1e6 << " MHz" <<
+		std::setw(10) << cycles * instructionsPerCycle / seconds / 1e6 << " M instructions/s\n";
+}
+
+template<typename Bus>
+void benchCore(const std::string& variant, const std::array<uint8_t, 0x10000>& program, uint32_t romStart, bool useRun, double instructionsPerCycle)
+{
+	auto bus{std::make_shared<Bus>(romStart)};
+	bus->m_memory = program;
+	Mos6502<Bus> cpu{bus};
+	cpu.flushDecodeCache();
+	cpu.reset();
+
+	const auto start{std::chrono::steady_clock::now()};
+	while (cpu.getCycleCount() < cyclesPerRun)
+	{
+		if (useRun)
+		{
+			cpu.run(cycleBudget
+#if defined(LIBMOS6502_LOG)
+				, log
+#endif
+			);
+		}
+		else
+		{
+			cpu.step(
+#if defined(LIBMOS6502_LOG)
+				log
+#endif
+			);
+		}
+	}
+	const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+	report(variant, cpu.getCycleCount(), elapsed.count(), instructionsPerCycle);
+}
+
+}
+
+// Measures the emulated clock rate of the core with each of its paths: the interpreter on RAM,
+// the decode cache and the blocks on ROM, through the templated and the virtual bus, next to the
+// reference interpreter. Runs the mix program of the tests, or the PRG-ROM of the iNES file given
+// as argument (test.nes from test.asm, for one).
+int main(int argc, char* argv[])
+{
+	std::array<uint8_t, 0x10000> program{};
+	if (argc > 1)
+	{
+		if (!loadINes(argv[1], program))
+		{
+			std::cerr << "Could not load " << argv[1] << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		assembleMixProgram(program);
+	}
+
+	// The reference counts the instructions, the cores run the same program for the same cycles
+	TestBus reference{};
+	reference.m_memory = program;
+	ReferenceCpu::Registers registers{static_cast<uint16_t>(program[0xFFFC] | program[0xFFFD] << 8), 0xFD, 0, 0, 0, 0x24};
+	uint64_t cycles{0};
+	uint64_t instructions{0};
+	const auto start{std::chrono::steady_clock::now()};
+	while (cycles < cyclesPerRun)
+	{
+		cycles += ReferenceCpu::step(registers, reference);
+		++instructions;
+	}
+	const std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+	const double instructionsPerCycle{static_cast<double>(instructions) / cycles};
+
+	report("reference", cycles, elapsed.count(), instructionsPerCycle);
+	benchCore<TestBus>("interpreter", program, 0x10000, false, instructionsPerCycle);
+	benchCore<TestBus>("decode cache", program, 0x8000, false, instructionsPerCycle);
+	benchCore<TestBus>("blocks", program, 0x8000, true, instructionsPerCycle);
+	benchCore<TestMemory>("virtual bus, decode cache", program, 0x8000, false, instructionsPerCycle);
+	benchCore<TestMemory>("virtual bus, blocks", program, 0x8000, true, instructionsPerCycle);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(LIBMOS6502_LOG)
+#include <fstream>
+#endif
+
+#include "libmos6502/mos6502.h"
+#include "reference_cpu.h"
+#include "test_bus.h"
+
+using namespace LibMos6502;
+using namespace LibMos6502::Test;
+
+namespace
+{
+
+int failures{0};
+
+void check(bool condition, const std::string& description)
+{
+	if (!condition)
+	{
+		if (++failures <= 20)
+		{
+			std::cout << "FAILED: " << description << "\n";
+		}
+	}
+}
+
+std::string hex(unsigned value, int width = 2)
+{
+	std::ostringstream stream;
+	stream << std::hex << std::uppercase << std::setfill('0') << std::setw(width) << value;
+	return stream.str();
+}
+
+#if defined(LIBMOS6502_LOG)
+// Never opened, the log lines go nowhere
+std::ofstream log;
+#endif
+
+template<typename Bus>
+void step(Mos6502<Bus>& cpu)
+{
+	cpu.step(
+#if defined(LIBMOS6502_LOG)
+		log
+#endif
+	);
+}
+
+template<typename Bus>
+uint32_t run(Mos6502<Bus>& cpu, uint32_t cycleBudget)
+{
+	return cpu.run(cycleBudget
+#if defined(LIBMOS6502_LOG)
+		, log
+#endif
+	);
+}
+
+template<typename Bus>
+typename Mos6502<Bus>::State makeState(const ReferenceCpu::Registers& registers)
+{
+	typename Mos6502<Bus>::State state{};
+	state.m_pc = registers.m_pc;
+	state.m_sp = registers.m_sp;
+	state.m_acc = registers.m_acc;
+	state.m_x = registers.m_x;
+	state.m_y = registers.m_y;
+	state.m_status = registers.m_status;
+	return state;
+}
+
+template<typename Bus>
+std::string compareRegisters(const typename Mos6502<Bus>::State& state, const ReferenceCpu::Registers& expected)
+{
+	std::string differences;
+	const auto compare{[&differences](const char* name, unsigned actual, unsigned wanted, int width = 2)
+	{
+		if (actual != wanted)
+		{
+			differences += std::string{" "} + name + " " + hex(actual, width) + " instead of " + hex(wanted, width);
+		}
+	}};
+	compare("PC", state.m_pc, expected.m_pc, 4);
+	compare("SP", state.m_sp, expected.m_sp);
+	compare("A", state.m_acc, expected.m_acc);
+	compare("X", state.m_x, expected.m_x);
+	compare("Y", state.m_y, expected.m_y);
+	compare("P", state.m_status, expected.m_status);
+	return differences;
+}
+
+// Runs every opcode with random registers, operands and memory on the core and on the reference,
+// comparing registers, flags, cycles and the writes in their order. Code in RAM goes through the
+// interpreter, code in ROM is run twice: decoding it, then from the decode cache.
+void checkOpcodes()
+{
+	constexpr int casesPerOpcode{300};
+	std::mt19937 random{6502};
+	std::array<uint8_t, 0x10000> memory;
+	std::generate(memory.begin(), memory.end(), [&random] { return static_cast<uint8_t>(random()); });
+
+	for (const bool inRom : {false, true})
+	{
+		auto bus{std::make_shared<TestBus>(inRom ? 0x8000 : 0x10000)};
+		TestBus reference{};
+		bus->m_memory = memory;
+		reference.m_memory = memory;
+		bus->m_logWrites = true;
+		reference.m_logWrites = true;
+		Mos6502<TestBus> cpu{bus};
+
+		for (unsigned opCode{0}; opCode < 0x100; ++opCode)
+		{
+			const std::string name{ReferenceCpu::opcodes[opCode].m_name.empty() ? "undocumented" : std::string{ReferenceCpu::opcodes[opCode].m_name}};
+			// Every ROM address is decoded once per flush, as ROM never changes
+			cpu.flushDecodeCache();
+
+			for (int testCase{0}; testCase < casesPerOpcode; ++testCase)
+			{
+				const auto pc{static_cast<uint16_t>(inRom ? 0x8000 + testCase * 0x47 : 0x0200 + random() % 0x7D00)};
+				ReferenceCpu::Registers registers{
+					pc,
+					static_cast<uint8_t>(random()),
+					static_cast<uint8_t>(random()),
+					static_cast<uint8_t>(random()),
+					static_cast<uint8_t>(random()),
+					// Bit 5 is always set, B only exists on the stack
+					static_cast<uint8_t>((random() & 0xCF) | 0x20)};
+				const std::array<uint8_t, 3> code{static_cast<uint8_t>(opCode), static_cast<uint8_t>(random()), static_cast<uint8_t>(random())};
+
+				const auto prepare{[&](auto& testBus)
+				{
+					for (size_t offset{0}; offset < code.size(); ++offset)
+					{
+						testBus.m_memory[static_cast<uint16_t>(pc + offset)] = code[offset];
+					}
+					testBus.m_writes.clear();
+				}};
+				const auto restore{[&](auto& testBus)
+				{
+					for (const auto& [address, data] : testBus.m_writes)
+					{
+						testBus.m_memory[address] = memory[address];
+					}
+					for (size_t offset{0}; offset < code.size(); ++offset)
+					{
+						testBus.m_memory[static_cast<uint16_t>(pc + offset)] = memory[static_cast<uint16_t>(pc + offset)];
+					}
+					testBus.m_writes.clear();
+				}};
+
+				prepare(reference);
+				ReferenceCpu::Registers expected{registers};
+				const uint32_t expectedCycles{ReferenceCpu::step(expected, reference)};
+				const auto expectedWrites{reference.m_writes};
+				restore(reference);
+
+				for (int pass{0}; pass < (inRom ? 2 : 1); ++pass)
+				{
+					prepare(*bus);
+					cpu.setState(makeState<TestBus>(registers));
+					step(cpu);
+
+					const std::string where{name + " (" + hex(opCode) + ") at " + hex(pc, 4) + (pass == 1 ? " from the decode cache" : "")};
+					const std::string differences{compareRegisters<TestBus>(cpu.getState(), expected)};
+					check(differences.empty(), where + ":" + differences);
+					check(cpu.getCycles() == expectedCycles, where + ": " + std::to_string(cpu.getCycles()) + " cycles instead of " + std::to_string(expectedCycles));
+					check(bus->m_writes == expectedWrites, where + ": writes differ");
+					restore(*bus);
+				}
+			}
+		}
+	}
+}
+
+// Runs a longer program on the reference and on the core with varying cycle budgets, comparing
+// registers, cycle counts and RAM after every run. The ROM variants go through the block path.
+template<typename Bus>
+void checkProgram(const std::string& variant, uint32_t romStart, bool singleSteps)
+{
+	auto bus{std::make_shared<Bus>(romStart)};
+	TestBus reference{};
+	assembleMixProgram(bus->m_memory);
+	assembleMixProgram(reference.m_memory);
+
+	Mos6502<Bus> cpu{bus};
+	cpu.flushDecodeCache();
+	cpu.reset();
+	ReferenceCpu::Registers registers{cpu.getState().m_pc, 0xFD, 0, 0, 0, 0x24};
+
+	constexpr std::array<uint32_t, 7> budgets{1, 2, 7, 113, 1000, 29781, 3};
+	uint64_t target{0};
+	uint64_t referenceCycles{0};
+	for (int run{0}; run < 400; ++run)
+	{
+		const uint32_t budget{budgets[run % budgets.size()]};
+		target += budget;
+		if (singleSteps)
+		{
+			while (cpu.getCycleCount() < target)
+			{
+				step(cpu);
+			}
+		}
+		else
+		{
+			::run(cpu, budget);
+		}
+
+		while (referenceCycles < target)
+		{
+			referenceCycles += ReferenceCpu::step(registers, reference);
+		}
+
+		const std::string where{variant + " after " + std::to_string(target) + " cycles"};
+		const std::string differences{compareRegisters<Bus>(cpu.getState(), registers)};
+		check(differences.empty(), where + ":" + differences);
+		check(cpu.getCycleCount() == referenceCycles, where + ": cycle count " + std::to_string(cpu.getCycleCount()) + " instead of " + std::to_string(referenceCycles));
+		check(std::equal(bus->m_memory.begin(), bus->m_memory.begin() + 0x800, reference.m_memory.begin()), where + ": RAM differs");
+		if (!differences.empty())
+		{
+			break;
+		}
+	}
+
+	// The program runs BRK once every 256 iterations, the IRQ handler counts them
+	check(reference.m_memory[0x1A] > 0, variant + ": BRK never reached the IRQ handler");
+}
+
+// NMI pushes the return address and the status with B clear, sets I and takes 7 cycles.
+// BRK does the same with B set, returning past its padding byte.
+void checkInterrupts()
+{
+	auto bus{std::make_shared<TestBus>()};
+	bus->m_memory[0xFFFA] = 0x00;
+	bus->m_memory[0xFFFB] = 0x90;
+	bus->m_memory[0xFFFE] = 0x00;
+	bus->m_memory[0xFFFF] = 0xA0;
+	bus->m_memory[0x1234] = 0x00; // BRK
+	bus->m_memory[0x1235] = 0xEA; // Padding, skipped
+	bus->m_memory[0xA000] = 0x40; // RTI
+	bus->m_memory[0x9000] = 0x40;
+	Mos6502<TestBus> cpu{bus};
+
+	ReferenceCpu::Registers registers{0x1234, 0xFF, 0, 0, 0, 0xE3};
+	cpu.setState(makeState<TestBus>(registers));
+	cpu.nmi();
+	step(cpu);
+	check(cpu.getState().m_pc == 0x9000 && cpu.getCycles() == 7, "NMI jumps through its vector in 7 cycles");
+	check(bus->m_memory[0x1FF] == 0x12 && bus->m_memory[0x1FE] == 0x34 && bus->m_memory[0x1FD] == 0xE3, "NMI pushes PC and the status with B clear");
+	check(cpu.getState().m_status == 0xE7, "NMI sets I");
+	step(cpu);
+	check(cpu.getState().m_pc == 0x1234 && cpu.getState().m_status == 0xE3, "RTI returns from NMI");
+
+	step(cpu);
+	check(cpu.getState().m_pc == 0xA000 && cpu.getCycles() == 7, "BRK jumps through the IRQ vector in 7 cycles");
+	check(bus->m_memory[0x1FF] == 0x12 && bus->m_memory[0x1FE] == 0x36 && bus->m_memory[0x1FD] == 0xF3, "BRK pushes PC + 2 and the status with B set");
+	step(cpu);
+	check(cpu.getState().m_pc == 0x1236 && cpu.getState().m_status == 0xE3, "RTI returns past the BRK padding byte");
+}
+
+// Two CPUs running the same ROM with a shared decode cache get the same results as a CPU of its own
+void checkSharedDecodeCache()
+{
+	auto busA{std::make_shared<TestBus>(0x8000)};
+	auto busB{std::make_shared<TestBus>(0x8000)};
+	assembleMixProgram(busA->m_memory);
+	assembleMixProgram(busB->m_memory);
+	Mos6502<TestBus> a{busA};
+	Mos6502<TestBus> b{busB};
+	a.flushDecodeCache();
+	b.shareDecodeCache(a);
+	a.reset();
+	b.reset();
+
+	for (int slice{0}; slice < 100; ++slice)
+	{
+		run(a, 997);
+		run(b, 997);
+		run(b, 13);
+		run(a, 13);
+	}
+	check(a.getCycleCount() == b.getCycleCount() && busA->m_memory == busB->m_memory, "CPUs sharing a decode cache run the same");
+	check(compareRegisters<TestBus>(a.getState(), {b.getState().m_pc, b.getState().m_sp, b.getState().m_acc, b.getState().m_x, b.getState().m_y, b.getState().m_status}).empty(),
+		"CPUs sharing a decode cache end with the same registers");
+}
+
+void checkConcurrentDecodeCache()
+{
+	constexpr int slices{200};
+	auto referenceBus{std::make_shared<TestBus>(0x8000)};
+	assembleMixProgram(referenceBus->m_memory);
+	Mos6502<TestBus> reference{referenceBus};
+	reference.flushDecodeCache();
+	reference.reset();
+	for (int slice{0}; slice < slices; ++slice)
+	{
+		run(reference, 997);
+	}
+
+	// Starts from an empty cache, so the CPUs fill it while the others read it
+	std::vector<std::shared_ptr<TestBus>> buses;
+	std::vector<std::unique_ptr<Mos6502<TestBus>>> cpus;
+	for (int i{0}; i < 4; ++i)
+	{
+		buses.push_back(std::make_shared<TestBus>(0x8000));
+		assembleMixProgram(buses.back()->m_memory);
+		cpus.push_back(std::make_unique<Mos6502<TestBus>>(buses.back()));
+		if (i == 0)
+		{
+			cpus.back()->flushDecodeCache();
+		}
+		else
+		{
+			cpus.back()->shareDecodeCache(*cpus.front());
+		}
+		cpus.back()->reset();
+	}
+
+	std::vector<std::thread> threads;
+	for (const std::unique_ptr<Mos6502<TestBus>>& cpu : cpus)
+	{
+		threads.emplace_back([&cpu = *cpu]
+		{
+#if defined(LIBMOS6502_LOG)
+			std::ofstream threadLog; // the shared one must not be written from several threads
+#endif
+			for (int slice{0}; slice < slices; ++slice)
+			{
+				cpu.run(997
+#if defined(LIBMOS6502_LOG)
+					, threadLog
+#endif
+				);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	const auto state{reference.getState()};
+	for (size_t i{0}; i < cpus.size(); ++i)
+	{
+		check(cpus[i]->getCycleCount() == reference.getCycleCount() && buses[i]->m_memory == referenceBus->m_memory,
+			"CPU " + std::to_string(i) + " sharing a decode cache across threads runs the same");
+		check(compareRegisters<TestBus>(cpus[i]->getState(), {state.m_pc, state.m_sp, state.m_acc, state.m_x, state.m_y, state.m_status}).empty(),
+			"CPU " + std::to_string(i) + " sharing a decode cache across threads ends with the same registers");
+	}
+}
+
+}
+
+// Conformance of the core against a straightforward reference interpreter.
+// Returns a failure exit code if anything differs.
+int main()
+{
+	checkOpcodes();
+	checkProgram<TestBus>("interpreter", 0x10000, true);
+	checkProgram<TestBus>("decode cache", 0x8000, true);
+	checkProgram<TestBus>("blocks", 0x8000, false);
+	checkProgram<TestMemory>("virtual bus blocks", 0x8000, false);
+	checkInterrupts();
+	checkSharedDecodeCache();
+	checkConcurrentDecodeCache();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "All checks passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,399 @@
+#ifndef REFERENCE_CPU_H
+#define REFERENCE_CPU_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace LibMos6502::Test
+{
+
+// A plain 6502 interpreter written for clarity rather than speed: one switch per opcode, the status
+// register kept as bits and every flag computed when the instruction runs. The tests check the core
+// against it. Like the core, it has no decimal mode (the NES CPU has none) and runs undocumented
+// opcodes as 2 cycle, 1 byte no-ops.
+class ReferenceCpu
+{
+public:
+	enum class Mode { Imp, Acc, Imm, Zp, ZpX, ZpY, Abs, AbX, AbY, Ind, IndX, IndY, Rel };
+
+	struct Opcode
+	{
+		std::string_view m_name; // Empty for undocumented opcodes
+		Mode m_mode;
+		uint8_t m_cycles;
+		bool m_pagePenalty; // One more cycle when indexing crosses a page
+	};
+
+	struct Registers
+	{
+		uint16_t m_pc;
+		uint8_t m_sp;
+		uint8_t m_acc;
+		uint8_t m_x, m_y;
+		uint8_t m_status;
+	};
+
+	static constexpr uint8_t carry{0x01}, zero{0x02}, interrupt{0x04}, decimal{0x08}, overflow{0x40}, negative{0x80};
+
+	static constexpr std::array<Opcode, 256> opcodes{[]
+	{
+		std::array<Opcode, 256> table{};
+		table.fill({"", Mode::Imp, 2, false});
+
+		// The eight addressing modes of the ALU group share their opcode layout
+		const auto alu{[&table](std::string_view name, uint8_t base)
+		{
+			table[base + 0x09] = {name, Mode::Imm, 2, false};
+			table[base + 0x05] = {name, Mode::Zp, 3, false};
+			table[base + 0x15] = {name, Mode::ZpX, 4, false};
+			table[base + 0x0D] = {name, Mode::Abs, 4, false};
+			table[base + 0x1D] = {name, Mode::AbX, 4, true};
+			table[base + 0x19] = {name, Mode::AbY, 4, true};
+			table[base + 0x01] = {name, Mode::IndX, 6, false};
+			table[base + 0x11] = {name, Mode::IndY, 5, true};
+		}};
+		alu("ORA", 0x00);
+		alu("AND", 0x20);
+		alu("EOR", 0x40);
+		alu("ADC", 0x60);
+		alu("LDA", 0xA0);
+		alu("CMP", 0xC0);
+		alu("SBC", 0xE0);
+
+		const auto shift{[&table](std::string_view name, uint8_t base)
+		{
+			table[base + 0x0A] = {name, Mode::Acc, 2, false};
+			table[base + 0x06] = {name, Mode::Zp, 5, false};
+			table[base + 0x16] = {name, Mode::ZpX, 6, false};
+			table[base + 0x0E] = {name, Mode::Abs, 6, false};
+			table[base + 0x1E] = {name, Mode::AbX, 7, false};
+		}};
+		shift("ASL", 0x00);
+		shift("ROL", 0x20);
+		shift("LSR", 0x40);
+		shift("ROR", 0x60);
+
+		table[0x85] = {"STA", Mode::Zp, 3, false};
+		table[0x95] = {"STA", Mode::ZpX, 4, false};
+		table[0x8D] = {"STA", Mode::Abs, 4, false};
+		table[0x9D] = {"STA", Mode::AbX, 5, false};
+		table[0x99] = {"STA", Mode::AbY, 5, false};
+		table[0x81] = {"STA", Mode::IndX, 6, false};
+		table[0x91] = {"STA", Mode::IndY, 6, false};
+		table[0x86] = {"STX", Mode::Zp, 3, false};
+		table[0x96] = {"STX", Mode::ZpY, 4, false};
+		table[0x8E] = {"STX", Mode::Abs, 4, false};
+		table[0x84] = {"STY", Mode::Zp, 3, false};
+		table[0x94] = {"STY", Mode::ZpX, 4, false};
+		table[0x8C] = {"STY", Mode::Abs, 4, false};
+
+		table[0xA2] = {"LDX", Mode::Imm, 2, false};
+		table[0xA6] = {"LDX", Mode::Zp, 3, false};
+		table[0xB6] = {"LDX", Mode::ZpY, 4, false};
+		table[0xAE] = {"LDX", Mode::Abs, 4, false};
+		table[0xBE] = {"LDX", Mode::AbY, 4, true};
+		table[0xA0] = {"LDY", Mode::Imm, 2, false};
+		table[0xA4] = {"LDY", Mode::Zp, 3, false};
+		table[0xB4] = {"LDY", Mode::ZpX, 4, false};
+		table[0xAC] = {"LDY", Mode::Abs, 4, false};
+		table[0xBC] = {"LDY", Mode::AbX, 4, true};
+
+		table[0xE0] = {"CPX", Mode::Imm, 2, false};
+		table[0xE4] = {"CPX", Mode::Zp, 3, false};
+		table[0xEC] = {"CPX", Mode::Abs, 4, false};
+		table[0xC0] = {"CPY", Mode::Imm, 2, false};
+		table[0xC4] = {"CPY", Mode::Zp, 3, false};
+		table[0xCC] = {"CPY", Mode::Abs, 4, false};
+		table[0x24] = {"BIT", Mode::Zp, 3, false};
+		table[0x2C] = {"BIT", Mode::Abs, 4, false};
+
+		table[0xC6] = {"DEC", Mode::Zp, 5, false};
+		table[0xD6] = {"DEC", Mode::ZpX, 6, false};
+		table[0xCE] = {"DEC", Mode::Abs, 6, false};
+		table[0xDE] = {"DEC", Mode::AbX, 7, false};
+		table[0xE6] = {"INC", Mode::Zp, 5, false};
+		table[0xF6] = {"INC", Mode::ZpX, 6, false};
+		table[0xEE] = {"INC", Mode::Abs, 6, false};
+		table[0xFE] = {"INC", Mode::AbX, 7, false};
+
+		table[0x10] = {"BPL", Mode::Rel, 2, false};
+		table[0x30] = {"BMI", Mode::Rel, 2, false};
+		table[0x50] = {"BVC", Mode::Rel, 2, false};
+		table[0x70] = {"BVS", Mode::Rel, 2, false};
+		table[0x90] = {"BCC", Mode::Rel, 2, false};
+		table[0xB0] = {"BCS", Mode::Rel, 2, false};
+		table[0xD0] = {"BNE", Mode::Rel, 2, false};
+		table[0xF0] = {"BEQ", Mode::Rel, 2, false};
+
+		table[0x00] = {"BRK", Mode::Imp, 7, false};
+		table[0x20] = {"JSR", Mode::Abs, 6, false};
+		table[0x40] = {"RTI", Mode::Imp, 6, false};
+		table[0x60] = {"RTS", Mode::Imp, 6, false};
+		table[0x4C] = {"JMP", Mode::Abs, 3, false};
+		table[0x6C] = {"JMP", Mode::Ind, 5, false};
+
+		table[0x08] = {"PHP", Mode::Imp, 3, false};
+		table[0x28] = {"PLP", Mode::Imp, 4, false};
+		table[0x48] = {"PHA", Mode::Imp, 3, false};
+		table[0x68] = {"PLA", Mode::Imp, 4, false};
+
+		table[0x18] = {"CLC", Mode::Imp, 2, false};
+		table[0x38] = {"SEC", Mode::Imp, 2, false};
+		table[0x58] = {"CLI", Mode::Imp, 2, false};
+		table[0x78] = {"SEI", Mode::Imp, 2, false};
+		table[0xB8] = {"CLV", Mode::Imp, 2, false};
+		table[0xD8] = {"CLD", Mode::Imp, 2, false};
+		table[0xF8] = {"SED", Mode::Imp, 2, false};
+
+		table[0x88] = {"DEY", Mode::Imp, 2, false};
+		table[0xCA] = {"DEX", Mode::Imp, 2, false};
+		table[0xC8] = {"INY", Mode::Imp, 2, false};
+		table[0xE8] = {"INX", Mode::Imp, 2, false};
+		table[0x8A] = {"TXA", Mode::Imp, 2, false};
+		table[0x98] = {"TYA", Mode::Imp, 2, false};
+		table[0x9A] = {"TXS", Mode::Imp, 2, false};
+		table[0xA8] = {"TAY", Mode::Imp, 2, false};
+		table[0xAA] = {"TAX", Mode::Imp, 2, false};
+		table[0xBA] = {"TSX", Mode::Imp, 2, false};
+		table[0xEA] = {"NOP", Mode::Imp, 2, false};
+		return table;
+	}()};
+
+	static constexpr uint8_t getLength(Mode mode)
+	{
+		switch (mode)
+		{
+		case Mode::Imp:
+		case Mode::Acc:
+			return 1;
+		case Mode::Abs:
+		case Mode::AbX:
+		case Mode::AbY:
+		case Mode::Ind:
+			return 3;
+		default:
+			return 2;
+		}
+	}
+
+	// Bus is any type with uint8_t read(uint16_t) and void write(uint16_t, uint8_t)
+	template<typename Bus>
+	static uint32_t step(Registers& registers, Bus& bus);
+};
+
+template<typename Bus>
+uint32_t ReferenceCpu::step(Registers& r, Bus& bus)
+{
+	const uint8_t opCode{bus.read(r.m_pc)};
+	const Opcode& op{opcodes[opCode]};
+	const uint8_t low{bus.read(static_cast<uint16_t>(r.m_pc + 1))};
+	const uint16_t word{static_cast<uint16_t>(low | (bus.read(static_cast<uint16_t>(r.m_pc + 2)) << 8))};
+	const uint16_t next{static_cast<uint16_t>(r.m_pc + (op.m_name.empty() ? 1 : getLength(op.m_mode)))};
+	uint32_t cycles{op.m_cycles};
+
+	const auto read16Zp{[&bus](uint8_t address)
+	{
+		return static_cast<uint16_t>(bus.read(address) | (bus.read(static_cast<uint8_t>(address + 1)) << 8));
+	}};
+	const auto indexed{[&](uint16_t base, uint8_t index)
+	{
+		const uint16_t address{static_cast<uint16_t>(base + index)};
+		if (op.m_pagePenalty && (address & 0xFF00) != (base & 0xFF00))
+		{
+			++cycles;
+		}
+		return address;
+	}};
+
+	uint16_t address{0};
+	switch (op.m_mode)
+	{
+	case Mode::Zp: address = low; break;
+	case Mode::ZpX: address = static_cast<uint8_t>(low + r.m_x); break;
+	case Mode::ZpY: address = static_cast<uint8_t>(low + r.m_y); break;
+	case Mode::Abs: address = word; break;
+	case Mode::AbX: address = indexed(word, r.m_x); break;
+	case Mode::AbY: address = indexed(word, r.m_y); break;
+	case Mode::IndX: address = read16Zp(static_cast<uint8_t>(low + r.m_x)); break;
+	case Mode::IndY: address = indexed(read16Zp(low), r.m_y); break;
+	case Mode::Ind:
+		// The high byte of the pointer is read from the same page
+		address = static_cast<uint16_t>(bus.read(word) | (bus.read(static_cast<uint16_t>((word & 0xFF00) | ((word + 1) & 0xFF))) << 8));
+		break;
+	default: break;
+	}
+
+	const auto setFlag{[&r](uint8_t flag, bool set)
+	{
+		r.m_status = set ? (r.m_status | flag) : (r.m_status & ~flag);
+	}};
+	const auto setNZ{[&](uint8_t value)
+	{
+		setFlag(zero, value == 0);
+		setFlag(negative, value & 0x80);
+		return value;
+	}};
+	const auto load{[&]
+	{
+		return op.m_mode == Mode::Imm ? low : bus.read(address);
+	}};
+	const auto push{[&](uint8_t value)
+	{
+		bus.write(static_cast<uint16_t>(0x100 + r.m_sp--), value);
+	}};
+	const auto pull{[&]
+	{
+		return bus.read(static_cast<uint16_t>(0x100 + ++r.m_sp));
+	}};
+	const auto add{[&](uint8_t value)
+	{
+		const unsigned sum{static_cast<unsigned>(r.m_acc + value + (r.m_status & carry))};
+		setFlag(overflow, ~(r.m_acc ^ value) & (r.m_acc ^ sum) & 0x80);
+		setFlag(carry, sum > 0xFF);
+		r.m_acc = setNZ(static_cast<uint8_t>(sum));
+	}};
+	const auto compare{[&](uint8_t reg)
+	{
+		const uint8_t value{load()};
+		setFlag(carry, reg >= value);
+		setNZ(static_cast<uint8_t>(reg - value));
+	}};
+	// Read-modify-write on the accumulator or memory
+	const auto modify{[&](auto operation)
+	{
+		if (op.m_mode == Mode::Acc)
+		{
+			r.m_acc = setNZ(operation(r.m_acc));
+		}
+		else
+		{
+			bus.write(address, setNZ(operation(bus.read(address))));
+		}
+	}};
+	const auto branch{[&](bool condition)
+	{
+		r.m_pc = next;
+		if (condition)
+		{
+			const auto target{static_cast<uint16_t>(next + static_cast<int8_t>(low))};
+			cycles += 1 + ((target & 0xFF00) != (next & 0xFF00));
+			r.m_pc = target;
+		}
+	}};
+	// Bits 4 and 5 don't exist in the register, pulling keeps them as they are
+	const auto pullStatus{[&]
+	{
+		r.m_status = (pull() & 0xCF) | (r.m_status & 0x30);
+	}};
+
+	const std::string_view name{op.m_name};
+	r.m_pc = next;
+	if (name == "ADC") add(load());
+	else if (name == "SBC") add(~load());
+	else if (name == "AND") r.m_acc = setNZ(r.m_acc & load());
+	else if (name == "ORA") r.m_acc = setNZ(r.m_acc | load());
+	else if (name == "EOR") r.m_acc = setNZ(r.m_acc ^ load());
+	else if (name == "LDA") r.m_acc = setNZ(load());
+	else if (name == "LDX") r.m_x = setNZ(load());
+	else if (name == "LDY") r.m_y = setNZ(load());
+	else if (name == "STA") bus.write(address, r.m_acc);
+	else if (name == "STX") bus.write(address, r.m_x);
+	else if (name == "STY") bus.write(address, r.m_y);
+	else if (name == "CMP") compare(r.m_acc);
+	else if (name == "CPX") compare(r.m_x);
+	else if (name == "CPY") compare(r.m_y);
+	else if (name == "BIT")
+	{
+		const uint8_t value{load()};
+		setFlag(zero, (value & r.m_acc) == 0);
+		setFlag(negative, value & 0x80);
+		setFlag(overflow, value & 0x40);
+	}
+	else if (name == "ASL") modify([&](uint8_t value) { setFlag(carry, value & 0x80); return static_cast<uint8_t>(value << 1); });
+	else if (name == "LSR") modify([&](uint8_t value) { setFlag(carry, value & 0x01); return static_cast<uint8_t>(value >> 1); });
+	else if (name == "ROL")
+	{
+		modify([&](uint8_t value)
+		{
+			const uint8_t in{static_cast<uint8_t>(r.m_status & carry)};
+			setFlag(carry, value & 0x80);
+			return static_cast<uint8_t>((value << 1) | in);
+		});
+	}
+	else if (name == "ROR")
+	{
+		modify([&](uint8_t value)
+		{
+			const uint8_t in{static_cast<uint8_t>((r.m_status & carry) << 7)};
+			setFlag(carry, value & 0x01);
+			return static_cast<uint8_t>((value >> 1) | in);
+		});
+	}
+	else if (name == "INC") modify([](uint8_t value) { return static_cast<uint8_t>(value + 1); });
+	else if (name == "DEC") modify([](uint8_t value) { return static_cast<uint8_t>(value - 1); });
+	else if (name == "INX") r.m_x = setNZ(r.m_x + 1);
+	else if (name == "INY") r.m_y = setNZ(r.m_y + 1);
+	else if (name == "DEX") r.m_x = setNZ(r.m_x - 1);
+	else if (name == "DEY") r.m_y = setNZ(r.m_y - 1);
+	else if (name == "TAX") r.m_x = setNZ(r.m_acc);
+	else if (name == "TAY") r.m_y = setNZ(r.m_acc);
+	else if (name == "TXA") r.m_acc = setNZ(r.m_x);
+	else if (name == "TYA") r.m_acc = setNZ(r.m_y);
+	else if (name == "TSX") r.m_x = setNZ(r.m_sp);
+	else if (name == "TXS") r.m_sp = r.m_x;
+	else if (name == "BPL") branch(!(r.m_status & negative));
+	else if (name == "BMI") branch(r.m_status & negative);
+	else if (name == "BVC") branch(!(r.m_status & overflow));
+	else if (name == "BVS") branch(r.m_status & overflow);
+	else if (name == "BCC") branch(!(r.m_status & carry));
+	else if (name == "BCS") branch(r.m_status & carry);
+	else if (name == "BNE") branch(!(r.m_status & zero));
+	else if (name == "BEQ") branch(r.m_status & zero);
+	else if (name == "JMP") r.m_pc = address;
+	else if (name == "JSR")
+	{
+		const auto returnAddress{static_cast<uint16_t>(next - 1)};
+		push(returnAddress >> 8);
+		push(returnAddress & 0xFF);
+		r.m_pc = address;
+	}
+	else if (name == "RTS")
+	{
+		const uint8_t returnLow{pull()};
+		r.m_pc = static_cast<uint16_t>(((pull() << 8) | returnLow) + 1);
+	}
+	else if (name == "BRK")
+	{
+		// The byte after the opcode is skipped
+		const auto returnAddress{static_cast<uint16_t>(next + 1)};
+		push(returnAddress >> 8);
+		push(returnAddress & 0xFF);
+		push(r.m_status | 0x30);
+		r.m_status |= interrupt;
+		r.m_pc = static_cast<uint16_t>(bus.read(0xFFFE) | (bus.read(0xFFFF) << 8));
+	}
+	else if (name == "RTI")
+	{
+		pullStatus();
+		const uint8_t returnLow{pull()};
+		r.m_pc = static_cast<uint16_t>((pull() << 8) | returnLow);
+	}
+	else if (name == "PHA") push(r.m_acc);
+	else if (name == "PHP") push(r.m_status | 0x30);
+	else if (name == "PLA") r.m_acc = setNZ(pull());
+	else if (name == "PLP") pullStatus();
+	else if (name == "CLC") setFlag(carry, false);
+	else if (name == "SEC") setFlag(carry, true);
+	else if (name == "CLI") setFlag(interrupt, false);
+	else if (name == "SEI") setFlag(interrupt, true);
+	else if (name == "CLV") setFlag(overflow, false);
+	else if (name == "CLD") setFlag(decimal, false);
+	else if (name == "SED") setFlag(decimal, true);
+
+	return cycles;
+}
+
+} // namespace LibMos6502::Test
+
+#endif // REFERENCE_CPU_H
@@ -15,11 +15,20 @@
     STA $02
     LDA #$FF
     LDA $00,X
+
+    BRK
+    NOP             ; Padding byte, skipped by RTI
+    LDA $04         ; Incremented once by the IRQ handler
 Loop:
     NOP
     JMP Loop
 .ENDPROC
-.RES $7FFA - .SIZEOF(Code), $00
+
+.PROC Irq
+    INC $04
+    RTI
+.ENDPROC
+.RES $7FFA - .SIZEOF(Code) - .SIZEOF(Irq), $00
 
 .SEGMENT "NMI_VECTOR"
 .ADDR $0000
@@ -28,7 +37,7 @@ Loop:
 .ADDR Code
 
 .SEGMENT "IRQ_VECTOR"
-.ADDR $0000
+.ADDR Irq
 
 .SEGMENT "CHRROM"
 .RES $2000, $AA
\ No newline at end of file
@@ -0,0 +1,283 @@
+#ifndef TEST_BUS_H
+#define TEST_BUS_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "libmos6502/memory.h"
+#include "reference_cpu.h"
+
+namespace LibMos6502::Test
+{
+
+// 64 KiB of flat memory without side effects. With romStart below 0x10000 the memory from there on
+// reports ROM offsets, so code placed there goes through the decode cache and the block paths.
+// Writes are logged when m_logWrites is set. Base is empty for the templated core and Memory for
+// the virtual one.
+template<typename Base>
+class BasicTestBus final : public Base
+{
+public:
+	explicit BasicTestBus(uint32_t romStart = 0x10000) :
+		m_memory{},
+		m_romStart{romStart},
+		m_logWrites{false},
+		m_writes{}
+	{
+	}
+
+	uint8_t read(uint16_t address)
+	{
+		return m_memory[address];
+	}
+
+	void write(uint16_t address, uint8_t data)
+	{
+		if (m_logWrites)
+		{
+			m_writes.emplace_back(address, data);
+		}
+		m_memory[address] = data;
+	}
+
+	size_t romOffset(uint16_t address)
+	{
+		return address >= m_romStart ? address - m_romStart : Memory::notRom;
+	}
+
+	size_t romSize()
+	{
+		return 0x10000 - m_romStart;
+	}
+
+	std::array<uint8_t, 0x10000> m_memory;
+	uint32_t m_romStart;
+	bool m_logWrites;
+	std::vector<std::pair<uint16_t, uint8_t>> m_writes;
+};
+
+struct NoBase
+{
+};
+
+using TestBus = BasicTestBus<NoBase>;
+using TestMemory = BasicTestBus<Memory>;
+
+// Assembles instructions into memory by mnemonic and addressing mode, with labels for branches
+// and jumps, so test programs can be written down readably.
+class Assembler
+{
+public:
+	using Mode = ReferenceCpu::Mode;
+
+	Assembler(std::array<uint8_t, 0x10000>& memory, uint16_t origin) :
+		m_memory{memory},
+		m_pc{origin},
+		m_labels{},
+		m_fixups{}
+	{
+	}
+
+	Assembler& operator()(std::string_view name, Mode mode = Mode::Imp, uint16_t operand = 0)
+	{
+		emit(getOpcode(name, mode), mode, operand);
+		return *this;
+	}
+
+	// Branches and absolute jumps to a label, which may be defined later
+	Assembler& operator()(std::string_view name, Mode mode, const std::string& label)
+	{
+		m_fixups.push_back({m_pc, mode, label});
+		emit(getOpcode(name, mode), mode, 0);
+		return *this;
+	}
+
+	Assembler& label(const std::string& name)
+	{
+		m_labels[name] = m_pc;
+		return *this;
+	}
+
+	Assembler& byte(uint8_t value)
+	{
+		m_memory[m_pc++] = value;
+		return *this;
+	}
+
+	uint16_t getAddress(const std::string& label) const
+	{
+		return m_labels.at(label);
+	}
+
+	uint16_t getPc() const
+	{
+		return m_pc;
+	}
+
+	// Resolves the label references, throws for undefined labels and branches out of range
+	void finish()
+	{
+		for (const Fixup& fixup : m_fixups)
+		{
+			const uint16_t target{m_labels.at(fixup.m_label)};
+			if (fixup.m_mode == Mode::Rel)
+			{
+				const int offset{target - (fixup.m_pc + 2)};
+				if (offset < -128 || offset > 127)
+				{
+					throw std::out_of_range{"Branch to " + fixup.m_label + " out of range"};
+				}
+				m_memory[static_cast<uint16_t>(fixup.m_pc + 1)] = static_cast<uint8_t>(offset);
+			}
+			else
+			{
+				m_memory[static_cast<uint16_t>(fixup.m_pc + 1)] = target & 0xFF;
+				m_memory[static_cast<uint16_t>(fixup.m_pc + 2)] = target >> 8;
+			}
+		}
+		m_fixups.clear();
+	}
+
+	static uint8_t getOpcode(std::string_view name, Mode mode)
+	{
+		for (size_t opCode{0}; opCode < ReferenceCpu::opcodes.size(); ++opCode)
+		{
+			if (ReferenceCpu::opcodes[opCode].m_name == name && ReferenceCpu::opcodes[opCode].m_mode == mode)
+			{
+				return static_cast<uint8_t>(opCode);
+			}
+		}
+		throw std::invalid_argument{"No opcode for " + std::string{name}};
+	}
+
+private:
+	struct Fixup
+	{
+		uint16_t m_pc;
+		Mode m_mode;
+		std::string m_label;
+	};
+
+	std::array<uint8_t, 0x10000>& m_memory;
+	uint16_t m_pc;
+	std::map<std::string, uint16_t> m_labels;
+	std::vector<Fixup> m_fixups;
+
+	void emit(uint8_t opCode, Mode mode, uint16_t operand)
+	{
+		m_memory[m_pc++] = opCode;
+		if (ReferenceCpu::getLength(mode) >= 2)
+		{
+			m_memory[m_pc++] = operand & 0xFF;
+		}
+		if (ReferenceCpu::getLength(mode) == 3)
+		{
+			m_memory[m_pc++] = operand >> 8;
+		}
+	}
+};
+
+// A program mixing every group of instructions: a 16 bit LFSR feeds table updates, arithmetic,
+// shifts, compares, branches both ways, stack operations, subroutines, indirect addressing and
+// BRK. Everything it writes is within the 2 KiB of RAM at 0x0000 - 0x07FF. Assembled at 0x8000
+// with the reset and IRQ vectors set.
+inline void assembleMixProgram(std::array<uint8_t, 0x10000>& memory)
+{
+	using Mode = ReferenceCpu::Mode;
+	Assembler a{memory, 0x8000};
+
+	a.label("reset")
+		("LDX", Mode::Imm, 0xFF)("TXS")
+		("LDA", Mode::Imm, 0xA5)("STA", Mode::Zp, 0x10)
+		("LDA", Mode::Imm, 0x3C)("STA", Mode::Zp, 0x11)
+		// Pointers for the indirect modes
+		("LDA", Mode::Imm, 0x00)("STA", Mode::Zp, 0x20)("STA", Mode::Zp, 0x22)
+		("LDA", Mode::Imm, 0x05)("STA", Mode::Zp, 0x21)
+		("LDA", Mode::Imm, 0x06)("STA", Mode::Zp, 0x23)
+		("LDX", Mode::Imm, 0x00);
+
+	a.label("loop")
+		// Galois LFSR: shift right, apply the taps when a one falls out
+		("LSR", Mode::Zp, 0x11)("ROR", Mode::Zp, 0x10)
+		("BCC", Mode::Rel, "noTap")
+		("LDA", Mode::Zp, 0x11)("EOR", Mode::Imm, 0xB4)("STA", Mode::Zp, 0x11)
+		.label("noTap")
+		("LDA", Mode::Zp, 0x10)
+		("STA", Mode::AbX, 0x0200)
+		("ADC", Mode::AbX, 0x0300)("STA", Mode::AbX, 0x0300)
+		("SBC", Mode::Zp, 0x11)
+		("BVS", Mode::Rel, "overflow")
+		("INC", Mode::Zp, 0x12)
+		.label("overflow")
+		("CMP", Mode::Imm, 0x80)
+		("BCS", Mode::Rel, "high")
+		("DEC", Mode::Zp, 0x13)
+		("JMP", Mode::Abs, "mixed")
+		.label("high")
+		("ROL", Mode::AbX, 0x0400)("ROR", Mode::Zp, 0x14)
+		.label("mixed")
+		("BIT", Mode::Zp, 0x10)
+		("BMI", Mode::Rel, "negative")
+		("ORA", Mode::Zp, 0x15)("AND", Mode::Imm, 0x7F)("STA", Mode::Zp, 0x15)
+		.label("negative")
+		("EOR", Mode::AbX, 0x0200)
+		("PHA")("PHP")
+		("JSR", Mode::Abs, "subroutine")
+		("PLP")("PLA")
+		("TAY")
+		("LDA", Mode::IndY, 0x20)("ADC", Mode::Zp, 0x16)("STA", Mode::Zp, 0x16)
+		("STA", Mode::IndY, 0x22)
+		("LDA", Mode::IndX, 0x20)
+		// Zero page indexed stores stay within 0x30 - 0x3F, clear of the pointers
+		("STX", Mode::Zp, 0x1B)("PHA")("TXA")("AND", Mode::Imm, 0x0F)("TAX")("PLA")
+		("EOR", Mode::ZpX, 0x30)("STA", Mode::ZpX, 0x30)
+		("LDX", Mode::Zp, 0x1B)
+		("CPY", Mode::Imm, 0x40)("BNE", Mode::Rel, "next")
+		("CPX", Mode::Zp, 0x16)
+		.label("next")
+		("INX")
+		("BEQ", Mode::Rel, "wrapped")
+		("JMP", Mode::Abs, "loop")
+		.label("wrapped")
+		("INC", Mode::Abs, 0x0017)
+		("BRK")("NOP")
+		("CLC")
+		("JMP", Mode::Ind, 0x0700);
+
+	a.label("subroutine")
+		("ASL", Mode::AbX, 0x0600)
+		("LSR", Mode::Zp, 0x14)
+		("TXA")("PHA") // The loop counter
+		("INY")("DEY")
+		("TSX")("TXS")
+		("LDY", Mode::ZpX, 0x30)("STY", Mode::Abs, 0x0018)
+		("LDX", Mode::Abs, 0x0018)("LDX", Mode::Zp, 0x19)("STX", Mode::Zp, 0x19)
+		("CLV")("SED")("CLD")("SEI")("CLI")("SEC")
+		("PLA")("TAX")
+		("RTS");
+
+	a.label("irq")
+		("INC", Mode::Zp, 0x1A)
+		("RTI");
+
+	a.finish();
+
+	// JMP (0x0700) goes back to the loop
+	memory[0x0700] = a.getAddress("loop") & 0xFF;
+	memory[0x0701] = a.getAddress("loop") >> 8;
+
+	memory[0xFFFC] = a.getAddress("reset") & 0xFF;
+	memory[0xFFFD] = a.getAddress("reset") >> 8;
+	memory[0xFFFE] = a.getAddress("irq") & 0xFF;
+	memory[0xFFFF] = a.getAddress("irq") >> 8;
+}
+
+} // namespace LibMos6502::Test
+
+#endif // TEST_BUS_H
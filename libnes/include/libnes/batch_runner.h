@@ -0,0 +1,66 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libnes/region.h"
+#include "libnes/screen.h"
+#include "libnes/work_stealing_pool.h"
+
+namespace LibNes
+{
+
+// Runs many independent emulator instances in parallel, each with its own screen and without
+// pacing, e.g. for regression runs over a set of ROMs. Instances share no state, only the ROM image.
+class BatchRunner
+{
+public:
+	struct Job
+	{
+		std::shared_ptr<const std::string> m_rom; // iNES image
+		uint64_t m_frames;
+		Region m_region;
+		bool m_spriteLimit;
+		// Called on the worker thread that runs the job. A NullScreen is used if empty.
+		std::function<std::shared_ptr<Screen>()> m_createScreen;
+	};
+
+	struct Result
+	{
+		bool m_loaded; // False if the ROM could not be loaded, the job did not run then
+		uint64_t m_frames;
+		uint64_t m_masterCycles;
+		std::chrono::nanoseconds m_time;
+		size_t m_worker;
+	};
+
+	struct Report
+	{
+		std::vector<Result> m_results; // In job order
+		std::chrono::nanoseconds m_time; // Wall time of the whole batch
+		size_t m_threadCount;
+
+		uint64_t getFrameCount() const;
+		double getFramesPerSecond() const;
+		double getFramesPerSecondPerCore() const;
+	};
+
+	explicit BatchRunner(size_t threadCount);
+
+	// Blocks until every job is done
+	Report run(const std::vector<Job>& jobs);
+
+private:
+	WorkStealingPool m_pool;
+
+	static Result runJob(const Job& job, size_t worker);
+};
+
+} // namespace LibNes
+
+#endif // BATCH_RUNNER_H
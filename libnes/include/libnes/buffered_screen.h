@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "libnes/screen.h"
+#include "libnes/triple_buffer.h"
+
+namespace LibNes
+{
+
+// Collects the scanlines of a frame and hands complete frames to a display thread through a
+// triple buffer. The emulation never waits for the display and the display never shows a torn frame.
+class BufferedScreen : public Screen
+{
+public:
+    struct Frame
+    {
+        std::array<uint8_t, width * height> m_paletteIndices;
+        std::array<uint8_t, height> m_emphasis;
+        // Hash of every scanline and its emphasis, rows with an unchanged hash need no upload
+        std::array<uint64_t, height> m_rowHashes;
+    };
+
+    void drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override
+    {
+        Frame& frame{m_frames.getWriteBuffer()};
+        std::copy(paletteIndices.begin(), paletteIndices.end(), frame.m_paletteIndices.begin() + y * width);
+        frame.m_emphasis[y] = emphasis;
+        frame.m_rowHashes[y] = hashRow(paletteIndices, emphasis);
+    }
+
+    void present() override
+    {
+        m_frames.publish();
+    }
+
+    // Display side: makes the latest complete frame current, returns false if there is no newer one
+    bool acquireFrame()
+    {
+        return m_frames.update();
+    }
+
+    const Frame& getFrame() const
+    {
+        return m_frames.getReadBuffer();
+    }
+
+    static uint64_t hashRow(std::span<const uint8_t, width> paletteIndices, uint8_t emphasis)
+    {
+        uint64_t hash{emphasis + 1ull};
+        for (size_t x = 0; x < width; x += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, paletteIndices.data() + x, sizeof(word));
+            hash = std::rotl(hash ^ (word * 0x9E3779B97F4A7C15ull), 27) * 0xBF58476D1CE4E5B9ull;
+        }
+        return hash;
+    }
+
+private:
+    TripleBuffer<Frame> m_frames;
+};
+
+}
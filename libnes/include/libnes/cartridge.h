@@ -5,6 +5,8 @@
 #include <functional>
 #include <memory>
 
+#include "pattern_cache.h"
+
 #include "libutilities/non_null.h"
 
 namespace LibNes
@@ -19,6 +21,8 @@ struct Cartridge
 		std::vector<uint8_t> m_trainer;
 		std::vector<uint8_t> m_prgRom;
 		std::vector<uint8_t> m_chrRom;
+		// Decoded once for all mappers and consoles using this ROM
+		PatternCache m_chrRomPatterns;
 
 		static constexpr size_t headerSize{4};
 		static constexpr char header[headerSize + 1]{'N', 'E', 'S', 0x1A, 0};
@@ -32,25 +36,47 @@ struct Cartridge
 			std::vector<uint8_t>&& chrRom) :
 			m_trainer{std::move(trainer)}, 
 			m_prgRom{std::move(prgRom)}, 
-			m_chrRom{std::move(chrRom)}
+			m_chrRom{std::move(chrRom)},
+			m_chrRomPatterns{m_chrRom}
 		{
 
 		}
 	};
 
+	using MapperFactory = std::function<NonNullSharedPtr<Mapper>(NonNullSharedPtr<Rom>)>;
+
 	NonNullSharedPtr<Rom> m_rom;
+	// Kept to insert the same cartridge into another console, which needs a mapper of its own
+	MapperFactory m_createMapper;
 	NonNullSharedPtr<Mapper> m_mapper;
 
 	Cartridge(
 		std::vector<uint8_t>&& trainer, 
 		std::vector<uint8_t>&& prgRom, 
 		std::vector<uint8_t>&& chrRom, 
-		std::function<NonNullSharedPtr<Mapper>(NonNullSharedPtr<Rom>)> mapper) :
-		m_rom{std::make_shared<Rom>(std::move(trainer), std::move(prgRom), std::move(chrRom))},
-		m_mapper{mapper(m_rom)}
+		MapperFactory createMapper) :
+		Cartridge{std::make_shared<Rom>(std::move(trainer), std::move(prgRom), std::move(chrRom)), createMapper}
 	{
 		
 	}
+
+	// Shares the ROM of another cartridge
+	Cartridge(NonNullSharedPtr<Rom> rom, MapperFactory createMapper) :
+		m_rom{rom},
+		m_createMapper{createMapper},
+		m_mapper{createMapper(rom)}
+	{
+
+	}
+
+	// Shares the ROM of another cartridge, with a copy of its mapper
+	Cartridge(NonNullSharedPtr<Rom> rom, MapperFactory createMapper, NonNullSharedPtr<Mapper> mapper) :
+		m_rom{rom},
+		m_createMapper{createMapper},
+		m_mapper{mapper}
+	{
+
+	}
 };
 
 } // namespace LibNes
@@ -1,33 +1,111 @@
 #ifndef CPU_MEMORY_H
 #define CPU_MEMORY_H
 
+#include <array>
 #include <memory>
 #include <optional>
 #include <vector>
 
 #include "libmos6502/memory.h"
+#include "libutilities/badge.h"
 #include "libutilities/non_null.h"
 
 #include "mapper.h"
+#include "region.h"
+
+namespace LibMos6502
+{
+template<typename Bus> class Mos6502;
+}
 
 namespace LibNes
 {
 
-class CpuMemory : public LibMos6502::Memory
+class Nes;
+class Ricoh2C02;
+
+class CpuMemory final : public LibMos6502::Memory
 {
 public:
 	CpuMemory(NonNullSharedPtr<std::vector<uint8_t>> ram);
 
 	uint8_t read(uint16_t address) override;
 	void write(uint16_t address, uint8_t data) override;
+	size_t romOffset(uint16_t address) override;
+	size_t romSize() override;
 
 	void setMapper(NonNullSharedPtr<Mapper> mapper);
 
+	// Accessing I/O registers stops a running CPU, so the other components can catch up.
+	void setCpu(LibMos6502::Mos6502<CpuMemory>& cpu, Badge<Nes>);
+	void setPpu(Ricoh2C02& ppu, Badge<Nes>);
+	// Clock ratio between the CPU and the PPU
+	void setRegion(Region region, Badge<Nes>);
+
+	// Maps size bytes of cartridge memory starting at address directly into the page table.
+	// PRG-ROM is mapped for reads only, so writes still reach the mapper.
+	void mapPrgRom(uint16_t address, size_t size, const std::vector<uint8_t>& prgRom, size_t offset, Badge<Mapper>);
+	void mapPrgRam(uint16_t address, size_t size, uint8_t* data, Badge<Mapper>);
+
+	static constexpr size_t pageSize{0x100};
+
 private:
 	NonNullSharedPtr<std::vector<uint8_t>> m_ram;
 	std::optional<NonNullSharedPtr<Mapper>> m_mapper;
+	LibMos6502::Mos6502<CpuMemory>* m_cpu;
+	Ricoh2C02* m_ppu;
+
+	// One entry per 256 byte page. Pages without a pointer (I/O registers and
+	// mapper registers) are handled by readSlow and writeSlow.
+	static constexpr size_t pageCount{0x100};
+	std::array<const uint8_t*, pageCount> m_readPages;
+	std::array<uint8_t*, pageCount> m_writePages;
+	std::array<size_t, pageCount> m_romOffsets;
+	size_t m_romSize;
+
+	static constexpr uint16_t cartridgeStart{0x4100}; // First whole page of cartridge space
+
+	uint8_t readSlow(uint16_t address);
+	void writeSlow(uint16_t address, uint8_t data);
+	void stopCpu();
+	// Catches the PPU up to the cycle of the current access
+	void syncPpu();
+
+	static constexpr uint16_t oamData{0x2004};
+	static constexpr uint16_t oamDma{0x4014};
+	uint64_t m_masterCyclesPerCpuCycle;
+	uint64_t m_masterCyclesPerPpuCycle;
 };
 
+// Defined inline so the CPU core instantiated over CpuMemory inlines the page table lookup
+inline uint8_t CpuMemory::read(uint16_t addr)
+{
+	if (const uint8_t* page{m_readPages[addr >> 8]})
+	{
+		return page[addr & 0xFF];
+	}
+
+	return readSlow(addr);
+}
+
+inline size_t CpuMemory::romOffset(uint16_t addr)
+{
+	const size_t offset{m_romOffsets[addr >> 8]};
+	return offset == notRom ? notRom : offset + (addr & 0xFF);
+}
+
+inline void CpuMemory::write(uint16_t addr, uint8_t data)
+{
+	if (uint8_t* page{m_writePages[addr >> 8]})
+	{
+		page[addr & 0xFF] = data;
+	}
+	else
+	{
+		writeSlow(addr, data);
+	}
+}
+
 }
 
 #endif // CPU_MEMORY_H
@@ -2,8 +2,10 @@
 #define MAPPER_H
 
 #include <memory>
+#include <span>
 
 #include "cartridge.h"
+#include "state.h"
 
 #include "libutilities/badge.h"
 
@@ -16,7 +18,7 @@ class Ricoh2C02;
 class Mapper
 {
 public:
-	enum class Mirroring { Vertical, Horizontal, FourScreen };
+	enum class Mirroring { Vertical, Horizontal, FourScreen, SingleScreenLower, SingleScreenUpper };
 
 	Mapper(NonNullSharedPtr<Cartridge::Rom> rom, const Mirroring& mirroring);
 
@@ -28,17 +30,66 @@ public:
 		uint8_t data, 
 		Badge<CpuMemory>) = 0;
 
-	virtual uint8_t read(
-		uint16_t address, 
-		Badge<Ricoh2C02>) = 0;
-	virtual void write(
-		uint16_t address, 
-		uint8_t data, 
-		Badge<Ricoh2C02>) = 0;
+	void attach(CpuMemory& cpuMemory, Badge<CpuMemory>);
+	void attach(Ricoh2C02& ppu, Badge<Ricoh2C02>);
+	// For a PPU copied together with this mapper, which has the CHR-RAM and the banks mapped already
+	void attachCopy(Ricoh2C02& ppu, Badge<Ricoh2C02>);
+
+	// A copy of the registers and RAM of this mapper, not attached to anything yet
+	virtual NonNullSharedPtr<Mapper> clone() const = 0;
+
+	// Mirroring, and the bank registers and cartridge RAM as written by writeState, pointing
+	// into the saved state
+	struct State
+	{
+		Mirroring m_mirroring;
+		std::span<const uint8_t> m_data;
+	};
+
+	// parseState only reads and checks a state, invalidating the reader if it doesn't fit this
+	// mapper, so loadState can't fail. Loading maps the restored banks again.
+	void saveState(StateWriter& writer) const;
+	void parseState(StateReader& reader, State& state) const;
+	void loadState(const State& state);
 
 protected:
+	Mapper(const Mapper& other);
+	Mapper& operator=(const Mapper&) = delete;
+
 	Mirroring m_mirroring;
 	NonNullSharedPtr<Cartridge::Rom> m_rom;
+
+	// Maps the currently selected PRG banks into the CPU page table. Called on attach;
+	// mappers with bank switching call it again whenever a bank register changes.
+	virtual void mapPrg() = 0;
+
+	void mapPrgRom(uint16_t address, size_t size, size_t offset);
+	void mapPrgRam(uint16_t address, size_t size, uint8_t* data);
+
+	// Maps the currently selected CHR banks and nametables into the PPU address space. Called on attach;
+	// mappers with bank switching or mirroring control call it again whenever a register changes.
+	virtual void mapPpu() = 0;
+
+	// Writes and reads the registers and RAM of the mapper, in the same order. The size written
+	// is the same for every state of a cartridge.
+	virtual size_t getStateSize() const = 0;
+	virtual void writeState(StateWriter& writer) const = 0;
+	virtual void readState(StateReader& reader) = 0;
+
+	// Maps CHR-ROM, or the CHR-RAM inside the PPU for cartridges without CHR-ROM
+	void mapChrMemory(uint16_t address, size_t size, size_t offset);
+	// Maps the four 1 KiB nametable slots onto the 2 KiB of console VRAM, or onto
+	// 4 KiB including the cartridge VRAM for four screen mirroring
+	void mapNametables(Mirroring mirroring);
+
+	bool hasChrRam() const;
+	size_t getChrSize() const;
+
+private:
+	CpuMemory* m_cpuMemory;
+	Ricoh2C02* m_ppu;
+
+	static constexpr size_t chrRamSize{0x2000};
 };
 
 } // namespace LibNes
@@ -1,11 +1,14 @@
 #ifndef NES_H
 #define NES_H
 
+#include "libutilities/badge.h"
 #include "libutilities/non_null.h"
 #include <array>
+#include <chrono>
 #include <functional>
 #include <istream>
 #include <memory>
+#include <span>
 #include <vector>
 
 #if defined(LIBNES_LOG)
@@ -18,6 +21,9 @@
 #include "libnes/cartridge.h"
 #include "libnes/mapper.h"
 #include "libnes/nrom.h"
+#include "libnes/ppu_renderer.h"
+#include "libnes/region.h"
+#include "libnes/scheduler.h"
 
 namespace LibNes
 {
@@ -26,20 +32,93 @@ class Nes
 {
 public:
 	Nes(NonNullSharedPtr<Screen> screen);
+	// Used by clone
+	Nes(const Nes& other, NonNullSharedPtr<Screen> screen, Badge<Nes>);
 
-	void loadCartridge(std::istream& romStream);
-	void runFor(std::chrono::nanoseconds time
+	// Returns false if the stream holds no complete iNES image, the image has no PRG-ROM or the
+	// mapper is not supported. The current cartridge stays in then.
+	bool loadCartridge(std::istream& romStream);
+	void reset();
+
+	// The run functions emulate as fast as possible and never sleep. Time is accounted in master
+	// clock cycles, so slicing a run differently gives the same result. Pacing to real time is up
+	// to the caller, using getMasterCycleCount() and the master clock of the region.
+
+	// Runs until the PPU finished the next frame and presented it
+	void runFrame(
+#if defined(LIBNES_LOG)
+		std::ofstream& log
+#endif
+	);
+	// Runs until the next vblank starts
+	void runUntilVblank(
+#if defined(LIBNES_LOG)
+		std::ofstream& log
+#endif
+	);
+	// Runs for the time of the given number of CPU cycles
+	void runCycles(uint64_t cycles
 #if defined(LIBNES_LOG)
 		, std::ofstream& log
 #endif
 	);
-	void reset();
+
+	// Master clock cycles since power on
+	uint64_t getMasterCycleCount() const;
+	// Frames finished since power on
+	uint64_t getFrameCount() const;
+
+	// Captures the state of the whole machine into a flat binary blob, replacing the contents of
+	// state but reusing its capacity. Requires a loaded cartridge.
+	void saveState(std::vector<uint8_t>& state) const;
+	// Restores a state saved with the same cartridge and region by this version of the library.
+	// Returns false and leaves the machine as it was if the state doesn't fit.
+	bool loadState(std::span<const uint8_t> state);
+
+	// Creates an independent console in the same state, drawing to the given screen, e.g. to
+	// explore several inputs from one point. The clone shares the ROM and everything decoded from
+	// it with this console. Only the machine state is copied, component by component: RAM, VRAM,
+	// OAM, palette, CHR-RAM with its decoded patterns, PRG-RAM and registers. The clone renders
+	// unthreaded and without run-ahead. Clones may run on different threads than this console and
+	// each other. Requires a loaded cartridge.
+	NonNullUniquePtr<Nes> clone(NonNullSharedPtr<Screen> screen) const;
+
+	// Clock rates and frame layout, NTSC by default. Has to be set before a cartridge is loaded.
+	void setRegion(Region region);
+	Region getRegion() const;
+
+	// Draws every sprite on a scanline instead of the first 8
+	void setSpriteLimit(bool enabled);
+
+	enum class RunAhead
+	{
+		Restore, // Saves the state before running ahead and loads it again afterwards
+		SecondInstance // Runs ahead on a second console loading the state, this one never goes back
+	};
+
+	struct RunAheadStatistics
+	{
+		uint64_t m_frames;
+		std::chrono::nanoseconds m_frameTime; // Emulating the frames themselves
+		std::chrono::nanoseconds m_runAheadTime; // Saving, running ahead and restoring on top of that
+
+		std::chrono::nanoseconds getRunAheadTimePerFrame() const;
+	};
+
+	// Games react to input a frame or two after reading it. With run-ahead, runFrame emulates the
+	// frame without showing it, then runs the given number of frames further and presents the last
+	// one, which hides that latency. 0 turns run-ahead off. Only runFrame runs ahead.
+	void setRunAhead(uint32_t frames, RunAhead mode = RunAhead::Restore);
+	RunAheadStatistics getRunAheadStatistics() const;
+
+	// Renders frames on a separate thread, calling the screen from there.
+	// Has to be set before a cartridge is loaded.
+	void setThreadedRendering(bool enabled);
 
 private:
+	NonNullSharedPtr<Screen> m_screen;
 	NonNullSharedPtr<std::vector<uint8_t>> m_ram;
 	static constexpr size_t ramSize{0x800};
-	NonNullSharedPtr<std::vector<uint8_t>> m_vram;
-	static constexpr size_t vramSize{0x800};
 
 	std::optional<NonNullUniquePtr<Cartridge>> m_cartridge;
 	
@@ -53,9 +132,59 @@ private:
 	};
 
 	NonNullSharedPtr<CpuMemory> m_cpuMemory;
-	NonNullUniquePtr<LibMos6502::Mos6502> m_cpu;
-	static constexpr std::chrono::nanoseconds cpuCycleTime{static_cast<uint16_t>(1000000000. / 1790000)}; // 1/(1.79 MHz)
+	NonNullUniquePtr<LibMos6502::Mos6502<CpuMemory>> m_cpu;
 	NonNullUniquePtr<Ricoh2C02> m_ppu;
+	// Declared after the cartridge, so it stops replaying before the CHR-ROM goes away
+	std::optional<NonNullUniquePtr<PpuRenderer>> m_renderer;
+
+	Region m_region;
+	RegionTiming m_timing;
+	Scheduler m_scheduler;
+	// Master clock time requested by runCycles. The CPU may run past it by part of an instruction,
+	// which the next run accounts for.
+	uint64_t m_targetTime;
+	uint64_t m_frameCount;
+
+	uint32_t m_runAheadFrames;
+	RunAhead m_runAheadMode;
+	std::optional<NonNullUniquePtr<Nes>> m_runAheadInstance;
+	std::vector<uint8_t> m_runAheadState;
+	RunAheadStatistics m_runAheadStatistics;
+
+	static constexpr uint32_t stateMagic{0x5353454E}; // "NESS"
+	static constexpr uint32_t stateVersion{2};
+	struct StateHeader
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+		uint32_t m_region;
+		uint32_t m_prgRomSize;
+		uint32_t m_chrRomSize;
+		uint32_t m_size; // Of the whole state
+	};
+	StateHeader getStateHeader(size_t size) const;
+
+	void insertCartridge(NonNullUniquePtr<Cartridge> cartridge);
+	// A powered off console with the settings and the cartridge ROM of this one
+	NonNullUniquePtr<Nes> createInstance(NonNullSharedPtr<Screen> screen, bool threaded) const;
+	void setOutputEnabled(bool enabled);
+	// Created on first use, with the cartridge and settings of this console
+	Nes& getRunAheadInstance();
+
+	void runUntilEvent(Scheduler::Event event
+#if defined(LIBNES_LOG)
+		, std::ofstream& log
+#endif
+	);
+	void runCpuUntil(uint64_t time
+#if defined(LIBNES_LOG)
+		, std::ofstream& log
+#endif
+	);
+	void catchUpPpu();
+	// Returns the time of the awaited event if it was among the handled ones
+	std::optional<uint64_t> handleEvents(std::optional<Scheduler::Event> awaited = std::nullopt);
+	void scheduleFromPpu(Scheduler::Event event, int16_t scanline, uint16_t cycle);
 };
 
 } // namespace LibNes
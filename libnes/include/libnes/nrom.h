@@ -11,8 +11,7 @@ class NRom : public Mapper
 public:
 	NRom(
 		NonNullSharedPtr<Cartridge::Rom> rom, 
-		const Mirroring& mirroring,
-		NonNullSharedPtr<std::vector<uint8_t>> vram);
+		const Mirroring& mirroring);
 
 	uint8_t read(
 		uint16_t address, 
@@ -22,16 +21,18 @@ public:
 		uint8_t data, 
 		Badge<CpuMemory>) override;
 
-	uint8_t read(
-		uint16_t address, 
-		Badge<Ricoh2C02>) override;
-	void write(
-		uint16_t address, 
-		uint8_t data, 
-		Badge<Ricoh2C02>) override;
+	NonNullSharedPtr<Mapper> clone() const override;
+
+protected:
+	void mapPrg() override;
+	void mapPpu() override;
+	size_t getStateSize() const override;
+	void writeState(StateWriter& writer) const override;
+	void readState(StateReader& reader) override;
 
 private:
-	NonNullSharedPtr<std::vector<uint8_t>> m_vram;
+	std::vector<uint8_t> m_prgRam;
+	static constexpr size_t prgRamSize{0x2000};
 };
 
 } // namespace LibNes
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+#include "libnes/screen.h"
+
+namespace LibNes
+{
+
+// Discards the picture, for runs that only need the emulation. Counts the frames it was given.
+class NullScreen : public Screen
+{
+public:
+    void drawScanline(uint16_t, std::span<const uint8_t, width>, uint8_t) override {}
+
+    void present() override
+    {
+        m_frameCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t getFrameCount() const
+    {
+        return m_frameCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> m_frameCount{0};
+};
+
+}
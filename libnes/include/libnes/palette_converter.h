@@ -0,0 +1,47 @@
+#ifndef PALETTE_CONVERTER_H
+#define PALETTE_CONVERTER_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "libnes/screen.h"
+
+namespace LibNes
+{
+
+// Expands the palette indices produced by the PPU into a pixel format via one table lookup per pixel.
+// Meant to run in the frontend once per frame, outside of the emulation loop.
+class PaletteConverter
+{
+public:
+	enum class Format 
+	{ 
+		Rgba8888, // Bytes in R, G, B, A order
+		Rgb565 // Native endian 16 bit words
+	};
+
+	explicit PaletteConverter(Format format);
+
+	Format getFormat() const;
+	size_t getBytesPerPixel() const;
+
+	// destination has to hold getBytesPerPixel() bytes per index. emphasis are PPUMASK bits 5 - 7.
+	void convert(std::span<const uint8_t> paletteIndices, uint8_t emphasis, uint8_t* destination) const;
+	void convertFrame(
+		std::span<const uint8_t, Screen::width * Screen::height> frame, 
+		std::span<const uint8_t, Screen::height> emphasis, 
+		uint8_t* destination) const;
+
+private:
+	Format m_format;
+	bool m_vectorized;
+
+	// Indexed by emphasis << 6 | palette index
+	static constexpr size_t tableSize{8 * 64};
+	std::array<uint32_t, tableSize> m_table;
+};
+
+} // namespace LibNes
+
+#endif // PALETTE_CONVERTER_H
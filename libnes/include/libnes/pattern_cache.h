@@ -0,0 +1,41 @@
+#ifndef PATTERN_CACHE_H
+#define PATTERN_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace LibNes
+{
+
+// CHR memory decoded into one word per 8 pixel tile row. Byte n of a row holds the 2 bit color
+// index of pixel n from the left, so renderers never have to combine the two bitplanes.
+class PatternCache
+{
+public:
+	explicit PatternCache(const std::vector<uint8_t>& chr);
+
+	// Decodes the tile row containing offset again after the CHR memory changed
+	void update(const std::vector<uint8_t>& chr, size_t offset);
+
+	// Rows of the tiles starting at the given CHR offset, 8 per tile
+	const uint64_t* getRows(size_t offset) const;
+
+	static uint64_t decode(uint8_t low, uint8_t high);
+	// Mirrors a row horizontally
+	static uint64_t flip(uint64_t row);
+	// 0xFF in every byte with a non-zero color index
+	static uint64_t getOpaqueMask(uint64_t row);
+
+	static constexpr size_t bytesPerTile{16};
+	static constexpr size_t rowsPerTile{8};
+
+private:
+	std::vector<uint64_t> m_rows;
+
+	static size_t getRowIndex(size_t offset);
+};
+
+} // namespace LibNes
+
+#endif // PATTERN_CACHE_H
@@ -0,0 +1,81 @@
+#ifndef PPU_RENDERER_H
+#define PPU_RENDERER_H
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <thread>
+
+#include "libnes/ricoh_2c02.h"
+#include "libnes/screen.h"
+#include "libnes/spsc_queue.h"
+#include "libutilities/non_null.h"
+
+namespace LibNes
+{
+
+// Everything the CPU side does to the PPU that changes what ends up on screen,
+// stamped with the PPU cycle count it happened at
+struct PpuEvent
+{
+	enum class Kind : uint8_t 
+	{ 
+		ReadRegister, 
+		WriteRegister, 
+		AllocateChrRam, 
+		MapChrRom, 
+		MapChrRam, 
+		MapNametable, 
+		SpriteLimit, 
+		Region, 
+		Output, 
+		FrameEnd, 
+		Stop 
+	};
+
+	uint64_t m_time;
+	Kind m_kind;
+	uint8_t m_data;
+	uint16_t m_address;
+	size_t m_size; // Nametable slot for MapNametable
+	size_t m_offset; // VRAM page for MapNametable
+	const uint8_t* m_chr;
+	const uint64_t* m_rows;
+};
+
+// Renders frames on a separate thread. The PPU driven by the CPU only keeps the timing
+// relevant state and records its events, which a second PPU replays to draw the frame.
+// Both PPUs go through the same state changes at the same cycles, so the picture is the
+// same as rendering on the CPU thread.
+class PpuRenderer
+{
+public:
+	PpuRenderer(NonNullSharedPtr<Screen> screen);
+	~PpuRenderer();
+
+	PpuRenderer(const PpuRenderer&) = delete;
+	PpuRenderer& operator=(const PpuRenderer&) = delete;
+
+	// Called by the recording PPU. Blocks while the queue is full.
+	void push(const PpuEvent& event);
+	// Blocks until every pushed event has been replayed
+	void finish();
+	// Replays the pushed events, then loads the state loaded into the recording PPU
+	void loadState(const Ricoh2C02::State& state);
+
+private:
+	NonNullUniquePtr<Ricoh2C02> m_ppu;
+
+	static constexpr size_t queueCapacity{0x8000};
+	SpscQueue<PpuEvent, queueCapacity> m_events;
+	uint64_t m_pushed;
+	std::atomic<uint64_t> m_replayed;
+
+	std::thread m_thread;
+
+	void run();
+};
+
+} // namespace LibNes
+
+#endif // PPU_RENDERER_H
@@ -0,0 +1,38 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <cstdint>
+
+namespace LibNes
+{
+
+enum class Region { Ntsc, Pal, Dendy };
+
+// Clocks and frame layout of a console region. The CPU and PPU clocks are divided from the master clock.
+struct RegionTiming
+{
+	// Master clock in Hz as a fraction, since the NTSC clock is 236.25 MHz / 11
+	uint64_t m_masterClockNumerator;
+	uint64_t m_masterClockDenominator;
+	uint64_t m_masterCyclesPerCpuCycle;
+	uint64_t m_masterCyclesPerPpuCycle;
+	int16_t m_scanlineCount; // Including the pre-render scanline
+	int16_t m_vblankScanline; // The vblank flag is set and NMI raised on cycle 1 of this scanline
+};
+
+constexpr RegionTiming getRegionTiming(Region region)
+{
+	switch (region)
+	{
+	case Region::Pal: // 26.6017125 MHz, 1.662607 MHz CPU
+		return RegionTiming{53203425, 2, 16, 5, 312, 241};
+	case Region::Dendy: // PAL clock with a faster CPU divider and vblank moved 50 scanlines down
+		return RegionTiming{53203425, 2, 15, 5, 312, 291};
+	default: // 21.477272 MHz, 1.789773 MHz CPU
+		return RegionTiming{236250000, 11, 12, 4, 262, 241};
+	}
+}
+
+} // namespace LibNes
+
+#endif // REGION_H
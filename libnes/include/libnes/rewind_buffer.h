@@ -0,0 +1,86 @@
+#ifndef REWIND_BUFFER_H
+#define REWIND_BUFFER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+namespace LibNes
+{
+
+class Nes;
+
+// Keeps the most recent save states in a ring of fixed size, so the emulation can be stepped
+// back frame by frame. Every keyframeInterval-th state is a keyframe, the states in between are
+// stored as the XOR against their keyframe. Both are compressed by collapsing runs of zero bytes,
+// which is most of a delta. When the ring is full, the oldest keyframe is dropped together
+// with its deltas.
+class RewindBuffer
+{
+public:
+	struct Statistics
+	{
+		uint64_t m_capturedFrames;
+		uint64_t m_keyframes;
+		size_t m_storedFrames;
+		size_t m_storedBytes; // Compressed, without the unused ends of the ring
+		size_t m_stateSize; // Of one uncompressed state
+		std::chrono::nanoseconds m_captureTime; // Spent in capture, in total
+		std::chrono::nanoseconds m_lastCaptureTime;
+
+		std::chrono::nanoseconds getAverageCaptureTime() const;
+		double getCompressionRatio() const;
+	};
+
+	explicit RewindBuffer(size_t capacity, uint32_t keyframeInterval = 60);
+
+	// Stores the current state of the NES. Called before every frame, each rewind then steps
+	// back by one frame. Returns false if the state doesn't fit into the ring at all.
+	bool capture(const Nes& nes);
+	// Restores the most recently captured state and drops it from the buffer. Takes the same
+	// time however many states are stored. Returns false if the buffer is empty.
+	bool rewind(Nes& nes);
+	void clear();
+
+	size_t getFrameCount() const;
+	size_t getCapacity() const;
+	Statistics getStatistics() const;
+
+	// The compression used for the ring. Decompressing XORs the data into the output, an output
+	// filled with zeros gets the original data.
+	static void compress(std::span<const uint8_t> data, std::vector<uint8_t>& compressed);
+	static void decompress(std::span<const uint8_t> compressed, std::span<uint8_t> output);
+
+private:
+	struct Entry
+	{
+		size_t m_offset; // In the ring
+		size_t m_size;
+		uint32_t m_framesSinceKeyframe; // 0 for keyframes
+		size_t m_keyframeOffset;
+		size_t m_keyframeSize;
+	};
+
+	std::vector<uint8_t> m_ring;
+	size_t m_head; // Where the next entry goes
+	std::deque<Entry> m_entries; // Oldest first
+	uint32_t m_keyframeInterval;
+
+	// Uncompressed keyframe of the newest entry, the base of the next delta
+	std::vector<uint8_t> m_keyframe;
+	std::vector<uint8_t> m_state;
+	std::vector<uint8_t> m_delta;
+	std::vector<uint8_t> m_compressed;
+
+	Statistics m_statistics;
+
+	// Makes room for size bytes, dropping the oldest entries, and returns the offset
+	size_t allocate(size_t size);
+	void dropOldest();
+};
+
+} // namespace LibNes
+
+#endif // REWIND_BUFFER_H
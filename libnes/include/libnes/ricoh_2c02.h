@@ -1,42 +1,265 @@
 #ifndef RICOH_2C02_H
 #define RICOH_2C02_H
 
+#include <array>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <span>
+#include <vector>
 
 #include "libnes/mapper.h"
+#include "libnes/pattern_cache.h"
+#include "libnes/region.h"
 #include "libnes/screen.h"
+#include "libnes/state.h"
+#include "libutilities/badge.h"
 #include "libutilities/non_null.h"
 
 namespace LibNes
 {
 
+class CpuMemory;
+class Nes;
+class PpuRenderer;
+struct PpuEvent;
+
 class Ricoh2C02
 {
 public:
     Ricoh2C02(NonNullSharedPtr<Screen> screen);
+    // A copy of another PPU with its registers, memory and memory map, drawing to another screen
+    // and without a renderer. The mapper is the copy of the mapper of the other PPU.
+    Ricoh2C02(const Ricoh2C02& other, NonNullSharedPtr<Screen> screen, NonNullSharedPtr<Mapper> mapper, Badge<Nes>);
 
     void step();
     uint16_t getCycle();
     int16_t getScanline();
 
+    // Cycles run since power on
+    uint64_t getCycleCount() const;
+    // Runs the PPU up to the given cycle count. Whole scanlines are rendered in bulk.
+    void catchUp(uint64_t cycleCount);
+
     void setMapper(NonNullSharedPtr<Mapper> mapper);
 
+    // The pattern tables at 0x0000 - 0x1FFF map CHR-ROM with its decoded pattern rows, or the CHR-RAM
+    // allocated inside the PPU. The four nametable slots at 0x2000 - 0x2FFF (mirrored up to 0x3EFF) map
+    // 1 KiB pages of VRAM: pages 0 and 1 are the console VRAM, pages 2 and 3 cartridge VRAM.
+    void allocateChrRam(size_t size, Badge<Mapper>);
+    void mapChrRom(uint16_t address, size_t size, const uint8_t* data, const uint64_t* rows, Badge<Mapper>);
+    void mapChrRam(uint16_t address, size_t size, size_t offset, Badge<Mapper>);
+    void mapNametable(size_t slot, size_t page, Badge<Mapper>);
+
     uint8_t read(uint16_t address) const;
     void write(uint16_t address, uint8_t data);
 
+    // Registers mapped to 0x2000 - 0x2007 (mirrored up to 0x3FFF).
+    // The caller has to catch the PPU up to the time of the access first.
+    uint8_t readRegister(uint16_t address, Badge<CpuMemory>);
+    void writeRegister(uint16_t address, uint8_t data, Badge<CpuMemory>);
+
+    // Number of cycles until the PPU reaches the given position the next time
+    uint32_t getCyclesUntil(int16_t scanline, uint16_t cycle) const;
+
+    // Returns true once for every NMI raised since the last call
+    bool pollNmi();
+
+    // The hardware draws at most 8 sprites per scanline. Without the limit every sprite on a
+    // scanline is drawn, which removes flicker. Sprite overflow is flagged either way.
+    void setSpriteLimit(bool enabled);
+    bool getSpriteLimit() const;
+
+    // Without output, frames are neither drawn nor presented to the screen. Sprite 0 hits are
+    // still detected, so the emulation runs the same.
+    void setOutputEnabled(bool enabled);
+
+    // Frame layout of the region: scanlines per frame and the vblank scanline
+    void setRegion(Region region);
+    int16_t getScanlineCount() const;
+    int16_t getVblankScanline() const;
+
+    // Registers, memory and position of the PPU as written by saveState. The memory blocks point
+    // into the saved state.
+    struct State
+    {
+        int16_t m_scanline;
+        uint16_t m_cycle;
+        uint64_t m_cycleCount;
+        uint64_t m_frameCount;
+        uint8_t m_control;
+        uint8_t m_mask;
+        uint8_t m_status;
+        uint8_t m_oamAddress;
+        uint8_t m_latch;
+        uint8_t m_readBuffer;
+        bool m_nmiRequested;
+        uint16_t m_v;
+        uint16_t m_t;
+        uint8_t m_x;
+        bool m_w;
+        std::span<const uint8_t> m_objectAttributeMemory;
+        std::span<const uint8_t> m_vram;
+        std::span<const uint8_t> m_paletteRam;
+        std::span<const uint8_t> m_chrRam;
+    };
+
+    // The memory map is not part of the state, the mapper maps its banks again after loading.
+    // parseState only reads and checks a state, invalidating the reader if it doesn't fit this
+    // PPU, so loadState can't fail. A renderer gets the loaded state as well.
+    void saveState(StateWriter& writer) const;
+    void parseState(StateReader& reader, State& state) const;
+    void loadState(const State& state);
+
+    // Hands rendering over to a PPU on another thread. This PPU then records its events for the
+    // renderer and only renders the scanlines needed to detect sprite 0 hits. Has to be set
+    // before a mapper is attached.
+    void setRenderer(PpuRenderer* renderer, Badge<Nes>);
+    void replay(const PpuEvent& event, Badge<PpuRenderer>);
+
+    // Palette indices of the last rendered frame, one byte per pixel. Empty until the first
+    // scanline is rendered.
+    std::span<const uint8_t> getFrameBuffer() const;
+    // Color emphasis bits of every scanline in the frame buffer
+    std::span<const uint8_t, Screen::height> getEmphasis() const;
+
+    static constexpr uint16_t cyclesPerScanline{341};
+    static constexpr int16_t preRenderScanline{-1};
+    static constexpr int16_t postRenderScanline{240};
+
 private:
     int16_t m_scanline;
     uint16_t m_cycle;
+    uint64_t m_cycleCount;
+    uint64_t m_frameCount;
+    Region m_region;
+    int16_t m_scanlineCount;
+    int16_t m_vblankScanline;
     NonNullSharedPtr<Screen> m_screen;
     std::optional<NonNullSharedPtr<Mapper>> m_mapper;
 
+    PpuRenderer* m_renderer;
+    void record(const PpuEvent& event);
+
+    void runCycle(uint16_t cycle);
+    void updateFlags();
+    void nextScanline();
+    void renderScanline();
+
+    // Renders a visible scanline at once from the current scroll position and sprite attributes
+    void renderLine();
+    // Palette RAM indices of the background, 0 for transparent pixels
+    void renderBackground(uint8_t* line);
+    void evaluateSprites();
+    void renderSprites();
+    bool isRenderingEnabled() const;
+    bool isSpriteZeroOnLine() const;
+    void incrementX(uint16_t& v) const;
+    void incrementY();
+    void copyX();
+    void copyY();
+
+    uint8_t m_control;
+    uint8_t m_mask;
+    uint8_t m_status;
+    uint8_t m_oamAddress;
+    uint8_t m_latch; // Last value written to or read from a register, returned by write-only registers
+    uint8_t m_readBuffer;
+    bool m_nmiRequested;
+
+    // Internal registers: current and temporary VRAM address, fine x scroll and write toggle
+    uint16_t m_v;
+    uint16_t m_t;
+    uint8_t m_x;
+    bool m_w;
+
+    struct ControlBits
+    {
+        static constexpr uint8_t Nametable{0x03};
+        static constexpr uint8_t Increment{0x04};
+        static constexpr uint8_t SpriteTable{0x08};
+        static constexpr uint8_t BackgroundTable{0x10};
+        static constexpr uint8_t SpriteSize{0x20};
+        static constexpr uint8_t NmiEnable{0x80};
+    };
+    struct MaskBits
+    {
+        static constexpr uint8_t Grayscale{0x01};
+        static constexpr uint8_t ShowBackgroundLeft{0x02};
+        static constexpr uint8_t ShowSpritesLeft{0x04};
+        static constexpr uint8_t ShowBackground{0x08};
+        static constexpr uint8_t ShowSprites{0x10};
+        static constexpr uint8_t Emphasis{0xE0};
+    };
+    struct StatusBits
+    {
+        static constexpr uint8_t SpriteOverflow{0x20};
+        static constexpr uint8_t SpriteZeroHit{0x40};
+        static constexpr uint8_t VBlank{0x80};
+    };
+
     std::vector<uint8_t> m_objectAttributeMemory;
     static constexpr size_t objectAttributeMemorySize{256};
+    static constexpr size_t objectCount{64};
+    static constexpr size_t spritesPerScanline{8};
+
+    struct AttributeBits
+    {
+        static constexpr uint8_t Palette{0x03};
+        static constexpr uint8_t BehindBackground{0x20};
+        static constexpr uint8_t FlipHorizontal{0x40};
+        static constexpr uint8_t FlipVertical{0x80};
+    };
+
+    // A sprite row on the current scanline, ready to be merged into the sprite line
+    struct LineSprite
+    {
+        uint64_t m_pixels; // Sprite line bytes, 0 where transparent
+        uint64_t m_mask; // 0xFF for opaque pixels
+        uint8_t m_x;
+    };
+
+    // Sprites on the current scanline in OAM order, which is also their priority
+    std::array<LineSprite, objectCount> m_lineSprites;
+    size_t m_lineSpriteCount;
+    bool m_spriteLimit;
+    bool m_outputEnabled;
+
+    // Sprite pixels of the current scanline: palette RAM index, priority and sprite 0 bits.
+    // Padded so sprites at the right edge can be written 8 pixels at a time.
+    std::array<uint8_t, Screen::width + 8> m_spriteLine;
+
+    // PPU address space map. Pattern tables and nametables are mapped in 1 KiB pages, holding
+    // CHR memory with its decoded pattern rows and the nametable slots respectively.
+    static constexpr size_t ppuPageSize{0x400};
+    std::array<const uint8_t*, 0x2000 / ppuPageSize> m_chrPages;
+    std::array<const uint64_t*, 0x2000 / ppuPageSize> m_patternPages;
+    std::array<size_t, 0x2000 / ppuPageSize> m_chrRamOffsets; // noChrRam for CHR-ROM pages
+    std::array<uint8_t*, 4> m_nametables;
+    uint64_t getPatternRow(uint16_t address) const;
+
+    std::vector<uint8_t> m_chrRam;
+    PatternCache m_chrRamPatterns;
+    std::array<uint8_t, 4 * ppuPageSize> m_vram;
+    static constexpr size_t noChrRam{std::numeric_limits<size_t>::max()};
+
+    std::array<uint8_t, 32> m_paletteRam;
+    static size_t getPaletteIndex(uint16_t address);
+
+    // Allocated with the first rendered scanline, a copied PPU starts without one
+    std::vector<uint8_t> m_frameBuffer;
+    std::array<uint8_t, Screen::height> m_emphasis;
 
     static constexpr int16_t scanlineDefault{241};
     static constexpr uint16_t cycleDefault{0};
+
+    uint8_t readRegister(uint16_t address);
+    void writeRegister(uint16_t address, uint8_t data);
+    void allocateChrRam(size_t size);
+    void mapChrRom(uint16_t address, size_t size, const uint8_t* data, const uint64_t* rows);
+    void mapChrRam(uint16_t address, size_t size, size_t offset);
+    void mapNametable(size_t slot, size_t page);
 };
 
 } // namespace LibNes
@@ -0,0 +1,54 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "libnes/state.h"
+
+namespace LibNes
+{
+
+// Keeps the points in time at which components have to interact, in master clock cycles.
+// Components run ahead until the next event is due and catch up before it is handled.
+class Scheduler
+{
+public:
+	enum class Event { VBlank, FrameEnd };
+
+	struct ScheduledEvent
+	{
+		Event m_event;
+		uint64_t m_time;
+	};
+
+	static constexpr uint64_t never{std::numeric_limits<uint64_t>::max()};
+
+	Scheduler();
+
+	// Replaces a pending occurrence of the same event
+	void schedule(Event event, uint64_t time);
+	void cancel(Event event);
+
+	uint64_t getTime() const;
+	void advanceTo(uint64_t time);
+
+	uint64_t getNextEventTime() const;
+	// Removes the earliest event if it is due at the current time
+	std::optional<ScheduledEvent> popDueEvent();
+
+	// Loading a state that doesn't fit invalidates the reader and leaves the scheduler partly
+	// loaded, so a state is loaded into a scheduler of its own first
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
+
+private:
+	std::vector<ScheduledEvent> m_queue; // Latest first, so the next event is popped from the back
+	uint64_t m_time;
+};
+
+} // namespace LibNes
+
+#endif // SCHEDULER_H
@@ -0,0 +1,75 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace LibNes
+{
+
+// Lock-free ring buffer between exactly one producer and one consumer thread.
+// The consumer can block until items arrive, the producer wakes it with notify().
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+	SpscQueue() :
+		m_items{},
+		m_writeIndex{0},
+		m_readIndex{0}
+	{
+	}
+
+	// Producer side
+	bool tryPush(const T& item)
+	{
+		const size_t writeIndex{m_writeIndex.load(std::memory_order_relaxed)};
+		if (writeIndex - m_readIndex.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+
+		m_items[writeIndex & (Capacity - 1)] = item;
+		m_writeIndex.store(writeIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	void notify()
+	{
+		m_writeIndex.notify_one();
+	}
+
+	// Consumer side
+	bool tryPop(T& item)
+	{
+		const size_t readIndex{m_readIndex.load(std::memory_order_relaxed)};
+		if (readIndex == m_writeIndex.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		item = m_items[readIndex & (Capacity - 1)];
+		m_readIndex.store(readIndex + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Blocks while the queue is empty, until the producer calls notify()
+	void wait()
+	{
+		m_writeIndex.wait(m_readIndex.load(std::memory_order_relaxed), std::memory_order_acquire);
+	}
+
+private:
+	std::array<T, Capacity> m_items;
+
+	// Kept on separate cache lines, each is written by one side only
+	alignas(64) std::atomic<size_t> m_writeIndex;
+	alignas(64) std::atomic<size_t> m_readIndex;
+};
+
+} // namespace LibNes
+
+#endif // SPSC_QUEUE_H
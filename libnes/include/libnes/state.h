@@ -0,0 +1,120 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace LibNes
+{
+
+// Appends the fields of a save state to a flat byte buffer. Values are copied as raw bytes in
+// native byte order, memory blocks with a single copy, so writing costs little more than the copies.
+class StateWriter
+{
+public:
+	explicit StateWriter(std::vector<uint8_t>& data) :
+		m_data{data}
+	{
+	}
+
+	template<typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be copied into a state");
+		write(&value, sizeof(T));
+	}
+
+	void write(const void* data, size_t size)
+	{
+		const auto* bytes{static_cast<const uint8_t*>(data)};
+		m_data.insert(m_data.end(), bytes, bytes + size);
+	}
+
+private:
+	std::vector<uint8_t>& m_data;
+};
+
+// Reads the fields back in the order they were written. Reading past the end leaves the
+// destination untouched and marks the reader invalid.
+class StateReader
+{
+public:
+	explicit StateReader(std::span<const uint8_t> data) :
+		m_data{data},
+		m_position{0},
+		m_valid{true}
+	{
+	}
+
+	template<typename T>
+	void read(T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be copied from a state");
+		read(&value, sizeof(T));
+	}
+
+	// Bytes other than 0 and 1 are no bool, they invalidate the state
+	void read(bool& value)
+	{
+		if (m_position == m_data.size() || m_data[m_position] > 1)
+		{
+			m_valid = false;
+			return;
+		}
+		value = m_data[m_position++] != 0;
+	}
+
+	void read(void* data, size_t size)
+	{
+		if (size > m_data.size() - m_position)
+		{
+			m_valid = false;
+			return;
+		}
+
+		std::memcpy(data, m_data.data() + m_position, size);
+		m_position += size;
+	}
+
+	// The next size bytes without copying them, valid as long as the state is. Empty past the end.
+	std::span<const uint8_t> readSpan(size_t size)
+	{
+		if (size > m_data.size() - m_position)
+		{
+			m_valid = false;
+			return {};
+		}
+
+		const std::span<const uint8_t> data{m_data.subspan(m_position, size)};
+		m_position += size;
+		return data;
+	}
+
+	// Marks the state as invalid, e.g. when a size stored in it does not match
+	void invalidate()
+	{
+		m_valid = false;
+	}
+
+	bool isValid() const
+	{
+		return m_valid;
+	}
+
+	bool isAtEnd() const
+	{
+		return m_position == m_data.size();
+	}
+
+private:
+	std::span<const uint8_t> m_data;
+	size_t m_position;
+	bool m_valid;
+};
+
+} // namespace LibNes
+
+#endif // STATE_H
@@ -0,0 +1,67 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace LibNes
+{
+
+// Hands complete buffers from one writer thread to one reader thread without locks. The writer
+// always owns a buffer to fill and the reader always owns the latest published one; the third
+// buffer sits between them and is swapped with atomic exchanges.
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :
+		m_buffers{},
+		m_writeIndex{0},
+		m_middle{1},
+		m_readIndex{2}
+	{
+	}
+
+	// Writer side
+	T& getWriteBuffer()
+	{
+		return m_buffers[m_writeIndex];
+	}
+
+	void publish()
+	{
+		m_writeIndex = m_middle.exchange(m_writeIndex | fresh, std::memory_order_acq_rel) & indexMask;
+	}
+
+	// Reader side. Takes over the latest published buffer, returns false if nothing was published since the last call.
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & fresh))
+		{
+			return false;
+		}
+
+		m_readIndex = m_middle.exchange(m_readIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	const T& getReadBuffer() const
+	{
+		return m_buffers[m_readIndex];
+	}
+
+private:
+	std::array<T, 3> m_buffers;
+
+	static constexpr uint8_t indexMask{0x03};
+	static constexpr uint8_t fresh{0x04}; // Set on the middle buffer when it was published and not read yet
+
+	alignas(64) uint8_t m_writeIndex;
+	alignas(64) std::atomic<uint8_t> m_middle;
+	alignas(64) uint8_t m_readIndex;
+};
+
+} // namespace LibNes
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,47 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace LibNes
+{
+
+// Runs a fixed set of independent tasks on a number of threads. Every thread starts on its own
+// share of the tasks, taking them from the back of its queue, and steals from the front of the
+// other queues once it runs dry, so long tasks on one thread don't leave the others idle.
+//
+// Tasks are coarse (whole emulator runs), so each queue is guarded by a plain mutex.
+class WorkStealingPool
+{
+public:
+	using Task = std::function<void(size_t task, size_t worker)>;
+
+	explicit WorkStealingPool(size_t threadCount);
+
+	size_t getThreadCount() const;
+
+	// Calls task for every index below taskCount and returns once all of them are done
+	void run(size_t taskCount, const Task& task);
+
+private:
+	size_t m_threadCount;
+
+	struct Queue
+	{
+		std::mutex m_mutex;
+		std::deque<size_t> m_tasks;
+	};
+
+	static std::optional<size_t> pop(Queue& queue);
+	static std::optional<size_t> steal(Queue& queue);
+	void work(std::vector<Queue>& queues, size_t worker, const Task& task);
+};
+
+} // namespace LibNes
+
+#endif // WORK_STEALING_POOL_H
@@ -0,0 +1,84 @@
+#include <sstream>
+
+#include "libnes/batch_runner.h"
+#include "libnes/nes.h"
+#include "libnes/null_screen.h"
+
+namespace LibNes
+{
+
+BatchRunner::BatchRunner(size_t threadCount) :
+	m_pool{threadCount}
+{
+
+}
+
+BatchRunner::Report BatchRunner::run(const std::vector<Job>& jobs)
+{
+	Report report{std::vector<Result>(jobs.size()), std::chrono::nanoseconds{0}, m_pool.getThreadCount()};
+
+	const auto start{std::chrono::steady_clock::now()};
+	m_pool.run(jobs.size(), [&](size_t job, size_t worker)
+	{
+		// Every job writes its own result, so no synchronization is needed
+		report.m_results[job] = runJob(jobs[job], worker);
+	});
+	report.m_time = std::chrono::steady_clock::now() - start;
+
+	return report;
+}
+
+BatchRunner::Result BatchRunner::runJob(const Job& job, size_t worker)
+{
+	const auto start{std::chrono::steady_clock::now()};
+
+	std::shared_ptr<Screen> screen{job.m_createScreen ? job.m_createScreen() : std::make_shared<NullScreen>()};
+	Nes nes{screen};
+	nes.setRegion(job.m_region);
+	nes.setSpriteLimit(job.m_spriteLimit);
+
+	std::istringstream rom{*job.m_rom};
+	if (!nes.loadCartridge(rom))
+	{
+		return Result{false, 0, 0, std::chrono::nanoseconds{0}, worker};
+	}
+	nes.reset();
+
+#if defined(LIBNES_LOG)
+	// Batch runs are not logged
+	std::ofstream log;
+#endif
+	while (nes.getFrameCount() < job.m_frames)
+	{
+		nes.runFrame(
+#if defined(LIBNES_LOG)
+			log
+#endif
+		);
+	}
+
+	return Result{true, nes.getFrameCount(), nes.getMasterCycleCount(), std::chrono::steady_clock::now() - start, worker};
+}
+
+uint64_t BatchRunner::Report::getFrameCount() const
+{
+	uint64_t frames{0};
+	for (const Result& result : m_results)
+	{
+		frames += result.m_frames;
+	}
+	return frames;
+}
+
+double BatchRunner::Report::getFramesPerSecond() const
+{
+	const double seconds{std::chrono::duration<double>(m_time).count()};
+	return seconds > 0 ? getFrameCount() / seconds : 0;
+}
+
+double BatchRunner::Report::getFramesPerSecondPerCore() const
+{
+	return getFramesPerSecond() / m_threadCount;
+}
+
+} // namespace LibNes
@@ -1,17 +1,29 @@
 #include <cassert>
 
 #include "libnes/cpu_memory.h"
+#include "libnes/ricoh_2c02.h"
+#include "libmos6502/mos6502.h"
 
 namespace LibNes
 {
 
 CpuMemory::CpuMemory(NonNullSharedPtr<std::vector<uint8_t>> ram) :
-	m_ram{ram}, m_mapper{}
+	m_ram{ram}, m_mapper{}, m_cpu{nullptr}, m_ppu{nullptr}, m_readPages{}, m_writePages{}, m_romOffsets{}, m_romSize{0},
+	m_masterCyclesPerCpuCycle{getRegionTiming(Region::Ntsc).m_masterCyclesPerCpuCycle},
+	m_masterCyclesPerPpuCycle{getRegionTiming(Region::Ntsc).m_masterCyclesPerPpuCycle}
 {
+	m_romOffsets.fill(notRom);
 
+	// Internal RAM is mirrored up to 0x1FFF
+	for (size_t page{0}; page < 0x2000 / pageSize; ++page)
+	{
+		uint8_t* data{m_ram->data() + (page * pageSize) % m_ram->size()};
+		m_readPages[page] = data;
+		m_writePages[page] = data;
+	}
 }
 
-uint8_t CpuMemory::read(uint16_t addr)
+uint8_t CpuMemory::readSlow(uint16_t addr)
 {
 	uint8_t data{0};
 
@@ -20,14 +32,16 @@ uint8_t CpuMemory::read(uint16_t addr)
 		data = m_ram->at(addr % m_ram->size());
 	}
 
-	else if (addr <= 0x3FFF) // TODO: PPU Registers
+	else if (addr <= 0x3FFF) // PPU Registers
 	{
-
+		stopCpu();
+		syncPpu();
+		data = m_ppu->readRegister(addr, Badge<CpuMemory>{});
 	}
 
 	else if (addr <= 0x4017) // TODO: NES API and I/O registers
 	{
-
+		stopCpu();
 	}
 
 	else if (addr <= 0x401F) // TODO: API and I/O functionality that is normally disabled.
@@ -35,7 +49,7 @@ uint8_t CpuMemory::read(uint16_t addr)
 
 	}
 
-	else if (addr <= 0xFFFF) // Cartridge space
+	else // Cartridge space
 	{
 		assert(m_mapper);
 		data = m_mapper.value()->read(addr, Badge<CpuMemory>{});
@@ -44,21 +58,36 @@ uint8_t CpuMemory::read(uint16_t addr)
 	return data;
 }
 
-void CpuMemory::write(uint16_t addr, uint8_t data)
+void CpuMemory::writeSlow(uint16_t addr, uint8_t data)
 {
 	if (addr <= 0x1FFF) // Internal RAM
 	{
 		m_ram->at(addr % m_ram->size()) = data;
 	}
 
-	else if (addr <= 0x3FFF) // TODO: PPU Register (addr % 8)
+	else if (addr <= 0x3FFF) // PPU Registers
 	{
+		stopCpu();
+		syncPpu();
+		m_ppu->writeRegister(addr, data, Badge<CpuMemory>{});
+	}
 
+	else if (addr == oamDma)
+	{
+		stopCpu();
+		syncPpu();
+		for (uint16_t offset{0}; offset < pageSize; ++offset)
+		{
+			m_ppu->writeRegister(oamData, read((data << 8) | offset), Badge<CpuMemory>{});
+		}
+
+		// One read and one write cycle per byte, plus alignment to an even cycle
+		m_cpu->stall(1 + (m_cpu->getCurrentCycle() & 1) + 2 * pageSize);
 	}
 
 	else if (addr <= 0x4017) // TODO: NES API and I/O registers
 	{
-
+		stopCpu();
 	}
 
 	else if (addr <= 0x401F) // TODO: API and I/O functionality that is normally disabled.
@@ -73,9 +102,85 @@ void CpuMemory::write(uint16_t addr, uint8_t data)
 	}
 }
 
+void CpuMemory::syncPpu()
+{
+	assert(m_cpu && m_ppu);
+	m_ppu->catchUp(m_cpu->getCurrentCycle() * m_masterCyclesPerCpuCycle / m_masterCyclesPerPpuCycle);
+}
+
+void CpuMemory::stopCpu()
+{
+	if (m_cpu)
+	{
+		m_cpu->requestStop();
+	}
+}
+
+size_t CpuMemory::romSize()
+{
+	return m_romSize;
+}
+
 void CpuMemory::setMapper(NonNullSharedPtr<Mapper> mapper)
 {
+	for (size_t page{cartridgeStart / pageSize}; page < pageCount; ++page)
+	{
+		m_readPages[page] = nullptr;
+		m_writePages[page] = nullptr;
+		m_romOffsets[page] = notRom;
+	}
+
+	m_romSize = 0;
 	m_mapper = mapper;
+	mapper->attach(*this, Badge<CpuMemory>{});
+}
+
+void CpuMemory::setCpu(LibMos6502::Mos6502<CpuMemory>& cpu, Badge<Nes>)
+{
+	m_cpu = &cpu;
+}
+
+void CpuMemory::setPpu(Ricoh2C02& ppu, Badge<Nes>)
+{
+	m_ppu = &ppu;
+}
+
+void CpuMemory::setRegion(Region region, Badge<Nes>)
+{
+	m_masterCyclesPerCpuCycle = getRegionTiming(region).m_masterCyclesPerCpuCycle;
+	m_masterCyclesPerPpuCycle = getRegionTiming(region).m_masterCyclesPerPpuCycle;
+}
+
+void CpuMemory::mapPrgRom(
+	uint16_t address, 
+	size_t size, 
+	const std::vector<uint8_t>& prgRom, 
+	size_t offset, 
+	Badge<Mapper>)
+{
+	assert(address >= cartridgeStart && address % pageSize == 0 && size % pageSize == 0);
+	assert(address + size <= pageCount * pageSize && offset + size <= prgRom.size());
+
+	m_romSize = prgRom.size();
+	for (size_t pageOffset{0}; pageOffset < size; pageOffset += pageSize)
+	{
+		m_readPages[(address + pageOffset) / pageSize] = prgRom.data() + offset + pageOffset;
+		m_writePages[(address + pageOffset) / pageSize] = nullptr;
+		m_romOffsets[(address + pageOffset) / pageSize] = offset + pageOffset;
+	}
+}
+
+void CpuMemory::mapPrgRam(uint16_t address, size_t size, uint8_t* data, Badge<Mapper>)
+{
+	assert(address >= cartridgeStart && address % pageSize == 0 && size % pageSize == 0);
+	assert(address + size <= pageCount * pageSize);
+
+	for (size_t offset{0}; offset < size; offset += pageSize)
+	{
+		m_readPages[(address + offset) / pageSize] = data + offset;
+		m_writePages[(address + offset) / pageSize] = data + offset;
+		m_romOffsets[(address + offset) / pageSize] = notRom;
+	}
 }
 
 } // namespace LibNes
@@ -1,13 +1,150 @@
+#include <array>
+
 #include "libnes/mapper.h"
+#include "libnes/cpu_memory.h"
+#include "libnes/ricoh_2c02.h"
 
 namespace LibNes
 {
 
 Mapper::Mapper(NonNullSharedPtr<Cartridge::Rom> rom, const Mirroring& mirroring) : 
+    m_mirroring{mirroring},
     m_rom{rom}, 
-    m_mirroring{mirroring}
+    m_cpuMemory{nullptr},
+    m_ppu{nullptr}
+{
+
+}
+
+Mapper::Mapper(const Mapper& other) :
+    m_mirroring{other.m_mirroring},
+    m_rom{other.m_rom},
+    m_cpuMemory{nullptr},
+    m_ppu{nullptr}
+{
+
+}
+
+void Mapper::attach(CpuMemory& cpuMemory, Badge<CpuMemory>)
+{
+    m_cpuMemory = &cpuMemory;
+    mapPrg();
+}
+
+void Mapper::attach(Ricoh2C02& ppu, Badge<Ricoh2C02>)
+{
+    m_ppu = &ppu;
+    m_ppu->allocateChrRam(hasChrRam() ? chrRamSize : 0, Badge<Mapper>{});
+    mapPpu();
+}
+
+void Mapper::attachCopy(Ricoh2C02& ppu, Badge<Ricoh2C02>)
+{
+    m_ppu = &ppu;
+}
+
+void Mapper::saveState(StateWriter& writer) const
+{
+    writer.write(m_mirroring);
+    writeState(writer);
+}
+
+void Mapper::parseState(StateReader& reader, State& state) const
+{
+    reader.read(state.m_mirroring);
+    state.m_data = reader.readSpan(getStateSize());
+
+    if (static_cast<uint32_t>(state.m_mirroring) > static_cast<uint32_t>(Mirroring::SingleScreenUpper))
+    {
+        reader.invalidate();
+    }
+}
+
+void Mapper::loadState(const State& state)
+{
+    m_mirroring = state.m_mirroring;
+    StateReader reader{state.m_data};
+    readState(reader);
+
+    mapPrg();
+    mapPpu();
+}
+
+void Mapper::mapPrgRom(uint16_t address, size_t size, size_t offset)
+{
+    if (m_cpuMemory)
+    {
+        m_cpuMemory->mapPrgRom(address, size, m_rom->m_prgRom, offset, Badge<Mapper>{});
+    }
+}
+
+void Mapper::mapPrgRam(uint16_t address, size_t size, uint8_t* data)
+{
+    if (m_cpuMemory)
+    {
+        m_cpuMemory->mapPrgRam(address, size, data, Badge<Mapper>{});
+    }
+}
+
+void Mapper::mapChrMemory(uint16_t address, size_t size, size_t offset)
 {
+    if (!m_ppu)
+    {
+        return;
+    }
 
+    if (hasChrRam())
+    {
+        m_ppu->mapChrRam(address, size, offset, Badge<Mapper>{});
+    }
+    else
+    {
+        m_ppu->mapChrRom(address, size, m_rom->m_chrRom.data() + offset, m_rom->m_chrRomPatterns.getRows(offset), Badge<Mapper>{});
+    }
+}
+
+void Mapper::mapNametables(Mirroring mirroring)
+{
+    if (!m_ppu)
+    {
+        return;
+    }
+
+    // VRAM pages, pages 2 and 3 are the cartridge VRAM
+    std::array<size_t, 4> pages;
+    switch (mirroring)
+    {
+    case Mirroring::Vertical:
+        pages = {0, 1, 0, 1};
+        break;
+    case Mirroring::Horizontal:
+        pages = {0, 0, 1, 1};
+        break;
+    case Mirroring::SingleScreenLower:
+        pages = {0, 0, 0, 0};
+        break;
+    case Mirroring::SingleScreenUpper:
+        pages = {1, 1, 1, 1};
+        break;
+    case Mirroring::FourScreen:
+        pages = {0, 1, 2, 3};
+        break;
+    }
+
+    for (size_t slot{0}; slot < pages.size(); ++slot)
+    {
+        m_ppu->mapNametable(slot, pages[slot], Badge<Mapper>{});
+    }
+}
+
+bool Mapper::hasChrRam() const
+{
+    return m_rom->m_chrRom.empty();
+}
+
+size_t Mapper::getChrSize() const
+{
+    return hasChrRam() ? chrRamSize : m_rom->m_chrRom.size();
 }
 
 } // namespace LibNes
@@ -1,29 +1,75 @@
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <iomanip>
-#include <thread>
 
 #include <iostream>
 
 #include "libnes/nes.h"
 #include "libnes/cpu_memory.h"
+#include "libnes/state.h"
 #include "libutilities/non_null.h"
 
 namespace LibNes
 {
 
 Nes::Nes(NonNullSharedPtr<Screen> screen) :
+	m_screen{screen},
 	m_ram{makeNonNullShared<std::vector<uint8_t>>(ramSize)},
+	m_cartridge{},
 	m_cpuMemory{makeNonNullShared<CpuMemory>(m_ram)},
-	m_cpu{makeNonNullUnique<LibMos6502::Mos6502>(
-		NonNullSharedPtr<LibMos6502::Memory>{m_cpuMemory})},
-	m_vram{makeNonNullShared<std::vector<uint8_t>>(vramSize)},
-	m_ppu{makeNonNullUnique<Ricoh2C02>(screen, m_vram)},
-	m_cartridge{}
+	m_cpu{makeNonNullUnique<LibMos6502::Mos6502<CpuMemory>>(m_cpuMemory)},
+	m_ppu{makeNonNullUnique<Ricoh2C02>(screen)},
+	m_renderer{},
+	m_region{Region::Ntsc},
+	m_timing{getRegionTiming(m_region)},
+	m_scheduler{},
+	m_targetTime{0},
+	m_frameCount{0},
+	m_runAheadFrames{0},
+	m_runAheadMode{RunAhead::Restore},
+	m_runAheadInstance{},
+	m_runAheadState{},
+	m_runAheadStatistics{0, std::chrono::nanoseconds{0}, std::chrono::nanoseconds{0}}
 {
+	m_cpuMemory->setCpu(*m_cpu, Badge<Nes>{});
+	m_cpuMemory->setPpu(*m_ppu, Badge<Nes>{});
+	setRegion(m_region);
+}
+
+Nes::Nes(const Nes& other, NonNullSharedPtr<Screen> screen, Badge<Nes>) :
+	m_screen{screen},
+	m_ram{makeNonNullShared<std::vector<uint8_t>>(*other.m_ram)},
+	m_cartridge{makeNonNullUnique<Cartridge>(
+		other.m_cartridge.value()->m_rom, 
+		other.m_cartridge.value()->m_createMapper, 
+		other.m_cartridge.value()->m_mapper->clone())},
+	m_cpuMemory{makeNonNullShared<CpuMemory>(m_ram)},
+	m_cpu{makeNonNullUnique<LibMos6502::Mos6502<CpuMemory>>(m_cpuMemory)},
+	m_ppu{makeNonNullUnique<Ricoh2C02>(*other.m_ppu, screen, m_cartridge.value()->m_mapper, Badge<Nes>{})},
+	m_renderer{},
+	m_region{other.m_region},
+	m_timing{other.m_timing},
+	m_scheduler{other.m_scheduler},
+	m_targetTime{other.m_targetTime},
+	m_frameCount{other.m_frameCount},
+	m_runAheadFrames{0},
+	m_runAheadMode{RunAhead::Restore},
+	m_runAheadInstance{},
+	m_runAheadState{},
+	m_runAheadStatistics{0, std::chrono::nanoseconds{0}, std::chrono::nanoseconds{0}}
+{
+	m_cpuMemory->setCpu(*m_cpu, Badge<Nes>{});
+	m_cpuMemory->setPpu(*m_ppu, Badge<Nes>{});
+	m_cpuMemory->setRegion(m_region, Badge<Nes>{});
+	m_cpuMemory->setMapper(m_cartridge.value()->m_mapper);
 
+	m_cpu->setState(other.m_cpu->getState());
+	// Both run the same ROM, so the instructions decoded by one serve the other
+	m_cpu->shareDecodeCache(*other.m_cpu);
 }
 
-void Nes::loadCartridge(std::istream& romStream)
+bool Nes::loadCartridge(std::istream& romStream)
 {
 	// Determine stream size
 	romStream.seekg(0, std::ios_base::end);
@@ -38,16 +84,15 @@ void Nes::loadCartridge(std::istream& romStream)
 		header[sizeof(header) - 1] = 0;
 		if (std::strcmp(header, Cartridge::Rom::header) != 0)
 		{
-			// TODO: Handle invalid header.
-			return;
+			return false;
 		}
 	}
 
-	char temp;
-	// Determine prg & chr ROM size
-	romStream.read(&temp, 1);
+	uint8_t temp;
+	// Determine prg & chr ROM size, the bank counts go up to 255
+	romStream.read(reinterpret_cast<char*>(&temp), 1);
 	auto prgRom{std::vector<uint8_t>(temp * Cartridge::Rom::prgRomSizeMultiplier)};
-	romStream.read(&temp, 1);
+	romStream.read(reinterpret_cast<char*>(&temp), 1);
 	auto chrRom{std::vector<uint8_t>(temp * Cartridge::Rom::chrRomSizeMultiplier)};
 
 	// Byte 6	NNNN FTBM
@@ -56,7 +101,7 @@ void Nes::loadCartridge(std::istream& romStream)
 	//			|||| |*--- Trainer present
 	//			|||| *---- Four screen mirroring
 	//			****------ Mapper number lower nibble
-	romStream.read(&temp, 1);
+	romStream.read(reinterpret_cast<char*>(&temp), 1);
 	auto mapperNumber{static_cast<size_t>((temp & 0xF0) >> 4)};
 	auto trainerPresent{static_cast<bool>(temp & 0x04)};
 	Mapper::Mirroring mirroring;
@@ -75,7 +120,7 @@ void Nes::loadCartridge(std::istream& romStream)
 	//			||||   |*- vs unisystem
 	//			||||   *-- pc10
 	//			****------ Mapper number higher nibble
-	romStream.read(&temp, 1);
+	romStream.read(reinterpret_cast<char*>(&temp), 1);
 	mapperNumber |= (temp & 0xF0);
 
 	// Rest of header (reserved)
@@ -90,11 +135,30 @@ void Nes::loadCartridge(std::istream& romStream)
 	romStream.read(reinterpret_cast<char*>(prgRom.data()), prgRom.size());
 	romStream.read(reinterpret_cast<char*>(chrRom.data()), chrRom.size());
 
-	m_cartridge.emplace(std::make_unique<Cartridge>(
+	if (!romStream.good() || prgRom.empty() || mapperNumber >= m_mapperList.size())
+	{
+		return false;
+	}
+
+	insertCartridge(makeNonNullUnique<Cartridge>(
 		std::move(trainer),
 		std::move(prgRom), 
 		std::move(chrRom), 
-		[&](NonNullSharedPtr<Cartridge::Rom> rom) { return m_mapperList[mapperNumber](rom, mirroring); }));
+		[createMapper = m_mapperList[mapperNumber], mirroring](NonNullSharedPtr<Cartridge::Rom> rom) { return createMapper(rom, mirroring); }));
+	m_cpu->flushDecodeCache();
+	return true;
+}
+
+void Nes::insertCartridge(NonNullUniquePtr<Cartridge> cartridge)
+{
+	// The renderer may still be replaying with the CHR-ROM of the previous cartridge
+	if (m_renderer)
+	{
+		m_renderer.value()->finish();
+	}
+	m_runAheadInstance.reset();
+
+	m_cartridge.emplace(std::move(cartridge));
 	m_cpuMemory->setMapper(m_cartridge.value()->m_mapper);
 	m_ppu->setMapper(m_cartridge.value()->m_mapper);
 }
@@ -104,44 +168,401 @@ void Nes::reset()
 	m_cpu->reset();
 }
 
-void Nes::runFor(std::chrono::nanoseconds time
+void Nes::setSpriteLimit(bool enabled)
+{
+	m_ppu->setSpriteLimit(enabled);
+	if (m_runAheadInstance)
+	{
+		m_runAheadInstance.value()->setSpriteLimit(enabled);
+	}
+}
+
+void Nes::setRunAhead(uint32_t frames, RunAhead mode)
+{
+	m_runAheadFrames = frames;
+	m_runAheadMode = mode;
+	if (frames == 0 || mode != RunAhead::SecondInstance)
+	{
+		m_runAheadInstance.reset();
+	}
+	setOutputEnabled(true);
+}
+
+Nes::RunAheadStatistics Nes::getRunAheadStatistics() const
+{
+	return m_runAheadStatistics;
+}
+
+std::chrono::nanoseconds Nes::RunAheadStatistics::getRunAheadTimePerFrame() const
+{
+	return m_frames > 0 ? m_runAheadTime / static_cast<int64_t>(m_frames) : std::chrono::nanoseconds{0};
+}
+
+void Nes::setThreadedRendering(bool enabled)
+{
+	assert(!m_cartridge);
+
+	m_renderer.reset();
+	if (enabled)
+	{
+		m_renderer.emplace(makeNonNullUnique<PpuRenderer>(m_screen));
+	}
+	m_ppu->setRenderer(m_renderer ? &*m_renderer.value() : nullptr, Badge<Nes>{});
+}
+
+void Nes::setRegion(Region region)
+{
+	assert(!m_cartridge);
+
+	m_region = region;
+	m_timing = getRegionTiming(region);
+	m_cpuMemory->setRegion(region, Badge<Nes>{});
+	m_ppu->setRegion(region);
+
+	// Right after the vblank flag is set on cycle 1, and after the last visible scanline
+	scheduleFromPpu(Scheduler::Event::VBlank, m_ppu->getVblankScanline(), 2);
+	scheduleFromPpu(Scheduler::Event::FrameEnd, Ricoh2C02::postRenderScanline, 0);
+}
+
+Region Nes::getRegion() const
+{
+	return m_region;
+}
+
+uint64_t Nes::getMasterCycleCount() const
+{
+	return m_scheduler.getTime();
+}
+
+uint64_t Nes::getFrameCount() const
+{
+	return m_frameCount;
+}
+
+void Nes::saveState(std::vector<uint8_t>& state) const
+{
+	assert(m_cartridge);
+
+	state.clear();
+	StateWriter writer{state};
+	writer.write(getStateHeader(0));
+
+	writer.write(m_targetTime);
+	writer.write(m_frameCount);
+	m_scheduler.saveState(writer);
+	// Field by field, the padding of the CPU state would end up in the state unchecked
+	const LibMos6502::Mos6502<CpuMemory>::State cpuState{m_cpu->getState()};
+	writer.write(cpuState.m_cycleCount);
+	writer.write(cpuState.m_cycleBalance);
+	writer.write(cpuState.m_pc);
+	writer.write(cpuState.m_sp);
+	writer.write(cpuState.m_acc);
+	writer.write(cpuState.m_x);
+	writer.write(cpuState.m_y);
+	writer.write(cpuState.m_status);
+	writer.write(cpuState.m_cycles);
+	writer.write(cpuState.m_nmiPending);
+	writer.write(m_ram->data(), m_ram->size());
+	m_ppu->saveState(writer);
+	m_cartridge.value()->m_mapper->saveState(writer);
+
+	const StateHeader header{getStateHeader(state.size())};
+	std::memcpy(state.data(), &header, sizeof(header));
+}
+
+bool Nes::loadState(std::span<const uint8_t> state)
+{
+	if (!m_cartridge || state.size() < sizeof(StateHeader))
+	{
+		return false;
+	}
+
+	// Everything else in the state has a fixed size for a given cartridge
+	StateHeader header;
+	std::memcpy(&header, state.data(), sizeof(header));
+	const StateHeader expected{getStateHeader(state.size())};
+	if (std::memcmp(&header, &expected, sizeof(header)) != 0)
+	{
+		return false;
+	}
+
+	// The whole state is read and checked before any of it is applied
+	StateReader reader{state.subspan(sizeof(header))};
+	uint64_t targetTime{0};
+	uint64_t frameCount{0};
+	Scheduler scheduler;
+	LibMos6502::Mos6502<CpuMemory>::State cpuState{};
+	Ricoh2C02::State ppuState{};
+	Mapper::State mapperState{};
+	reader.read(targetTime);
+	reader.read(frameCount);
+	scheduler.loadState(reader);
+	reader.read(cpuState.m_cycleCount);
+	reader.read(cpuState.m_cycleBalance);
+	reader.read(cpuState.m_pc);
+	reader.read(cpuState.m_sp);
+	reader.read(cpuState.m_acc);
+	reader.read(cpuState.m_x);
+	reader.read(cpuState.m_y);
+	reader.read(cpuState.m_status);
+	reader.read(cpuState.m_cycles);
+	reader.read(cpuState.m_nmiPending);
+	const std::span<const uint8_t> ram{reader.readSpan(m_ram->size())};
+	m_ppu->parseState(reader, ppuState);
+	m_cartridge.value()->m_mapper->parseState(reader, mapperState);
+	if (!reader.isValid() || !reader.isAtEnd())
+	{
+		return false;
+	}
+
+	m_targetTime = targetTime;
+	m_frameCount = frameCount;
+	m_scheduler = scheduler;
+	m_cpu->setState(cpuState);
+	std::copy(ram.begin(), ram.end(), m_ram->begin());
+	m_ppu->loadState(ppuState);
+	m_cartridge.value()->m_mapper->loadState(mapperState);
+	return true;
+}
+
+Nes::StateHeader Nes::getStateHeader(size_t size) const
+{
+	const Cartridge::Rom& rom{*m_cartridge.value()->m_rom};
+	return StateHeader{
+		stateMagic,
+		stateVersion,
+		static_cast<uint32_t>(m_region),
+		static_cast<uint32_t>(rom.m_prgRom.size()),
+		static_cast<uint32_t>(rom.m_chrRom.size()),
+		static_cast<uint32_t>(size)};
+}
+
+void Nes::runFrame(
 #if defined(LIBNES_LOG)
-	, std::ofstream& log
+	std::ofstream& log
+#endif
+)
+{
+	if (m_runAheadFrames == 0 || !m_cartridge)
+	{
+		runUntilEvent(Scheduler::Event::FrameEnd
+#if defined(LIBNES_LOG)
+			, log
+#endif
+		);
+		return;
+	}
+
+	const auto start{std::chrono::steady_clock::now()};
+	setOutputEnabled(false);
+	runUntilEvent(Scheduler::Event::FrameEnd
+#if defined(LIBNES_LOG)
+		, log
+#endif
+	);
+	const auto frameEnd{std::chrono::steady_clock::now()};
+
+	saveState(m_runAheadState);
+	Nes& ahead{m_runAheadMode == RunAhead::SecondInstance ? getRunAheadInstance() : *this};
+	bool loaded{&ahead == this || ahead.loadState(m_runAheadState)};
+	if (loaded)
+	{
+		for (uint32_t frame{1}; frame <= m_runAheadFrames; ++frame)
+		{
+			ahead.setOutputEnabled(frame == m_runAheadFrames);
+			ahead.runUntilEvent(Scheduler::Event::FrameEnd
+#if defined(LIBNES_LOG)
+				, log
+#endif
+			);
+		}
+
+		if (&ahead == this)
+		{
+			loaded = loadState(m_runAheadState);
+		}
+	}
+
+	// A state of this very console always loads. Should it not, running ahead stops rather than
+	// leaving this console ahead of time or without output.
+	if (!loaded)
+	{
+		setRunAhead(0);
+		return;
+	}
+	// Shows whatever runs on this console until the next frame hides it again
+	setOutputEnabled(true);
+
+	++m_runAheadStatistics.m_frames;
+	m_runAheadStatistics.m_frameTime += frameEnd - start;
+	m_runAheadStatistics.m_runAheadTime += std::chrono::steady_clock::now() - frameEnd;
+}
+
+void Nes::runUntilVblank(
+#if defined(LIBNES_LOG)
+	std::ofstream& log
 #endif
 )
 {
-	const std::chrono::time_point start = std::chrono::steady_clock::now();
+	runUntilEvent(Scheduler::Event::VBlank
+#if defined(LIBNES_LOG)
+		, log
+#endif
+	);
+}
 
+void Nes::runCycles(uint64_t cycles
+#if defined(LIBNES_LOG)
+	, std::ofstream& log
+#endif
+)
+{
+	m_targetTime += cycles * m_timing.m_masterCyclesPerCpuCycle;
+	while (m_scheduler.getTime() < m_targetTime)
+	{
+		runCpuUntil(std::min(m_targetTime, m_scheduler.getNextEventTime())
 #if defined(LIBNES_LOG)
-	uint16_t lastCycle;
-	int16_t lastScanline;
+			, log
 #endif
+		);
+		handleEvents();
+	}
+}
 
-	for(int64_t iterator{time / cpuCycleTime}; iterator > 0; iterator -= m_cpu->getCycles())
+void Nes::runUntilEvent(Scheduler::Event event
+#if defined(LIBNES_LOG)
+	, std::ofstream& log
+#endif
+)
+{
+	std::optional<uint64_t> time;
+	while (!time)
 	{
-		m_cpu->step(
+		runCpuUntil(m_scheduler.getNextEventTime()
 #if defined(LIBNES_LOG)
-			log
+			, log
 #endif
 		);
+		time = handleEvents(event);
+	}
+
+	// Later runCycles calls count from the event
+	m_targetTime = *time;
+}
 
+void Nes::runCpuUntil(uint64_t time
 #if defined(LIBNES_LOG)
-		lastCycle = m_ppu->getCycle();
-		lastScanline = m_ppu->getScanline();
+	, std::ofstream& log
 #endif
+)
+{
+#if defined(LIBNES_LOG)
+	// Logged runs step single instructions, so every line shows the PPU position it started at
+	(void)time;
+	catchUpPpu();
+	const uint16_t cycle{m_ppu->getCycle()};
+	const int16_t scanline{m_ppu->getScanline()};
+
+	m_cpu->step(log);
+
+	log << 
+		" CYC:" << std::setw(3) << std::setfill(' ') << std::right << std::dec << cycle << 
+		" SL:" << std::left << scanline << "\n";
+#else
+	// The CPU keeps cycles it was given but did not execute yet (or executed in advance) in its
+	// balance, so the budget is measured from everything handed to it so far.
+	const uint64_t masterCyclesPerCpuCycle{m_timing.m_masterCyclesPerCpuCycle};
+	const auto target{static_cast<int64_t>((time + masterCyclesPerCpuCycle - 1) / masterCyclesPerCpuCycle)};
+	const int64_t scheduled{static_cast<int64_t>(m_cpu->getCycleCount()) + m_cpu->getCycleBalance()};
+	m_cpu->run(static_cast<uint32_t>(std::max<int64_t>(target - scheduled, 0)));
+#endif
+
+	m_scheduler.advanceTo(m_cpu->getCycleCount() * m_timing.m_masterCyclesPerCpuCycle);
+}
+
+void Nes::catchUpPpu()
+{
+	m_ppu->catchUp(m_scheduler.getTime() / m_timing.m_masterCyclesPerPpuCycle);
+}
+
+void Nes::setOutputEnabled(bool enabled)
+{
+	// Frames are hidden from the current cycle on
+	catchUpPpu();
+	m_ppu->setOutputEnabled(enabled);
+}
+
+Nes& Nes::getRunAheadInstance()
+{
+	if (!m_runAheadInstance)
+	{
+		m_runAheadInstance.emplace(createInstance(m_screen, m_renderer.has_value()));
+	}
+	return *m_runAheadInstance.value();
+}
+
+NonNullUniquePtr<Nes> Nes::createInstance(NonNullSharedPtr<Screen> screen, bool threaded) const
+{
+	auto instance{makeNonNullUnique<Nes>(screen)};
+	instance->setRegion(m_region);
+	instance->setSpriteLimit(m_ppu->getSpriteLimit());
+	instance->setThreadedRendering(threaded);
+	instance->insertCartridge(makeNonNullUnique<Cartridge>(m_cartridge.value()->m_rom, m_cartridge.value()->m_createMapper));
+	// Both run the same ROM, so the instructions decoded by one serve the other
+	instance->m_cpu->shareDecodeCache(*m_cpu);
+	return instance;
+}
+
+NonNullUniquePtr<Nes> Nes::clone(NonNullSharedPtr<Screen> screen) const
+{
+	assert(m_cartridge);
+
+	// Copies the components directly instead of building a powered off console and loading a
+	// save state into it, which would decode CHR-RAM again and allocate everything twice
+	return makeNonNullUnique<Nes>(*this, screen, Badge<Nes>{});
+}
 
-		for(uint8_t iteratorPpu = 0; iteratorPpu < 3 * m_cpu->getCycles(); ++iteratorPpu)
+std::optional<uint64_t> Nes::handleEvents(std::optional<Scheduler::Event> awaited)
+{
+	std::optional<uint64_t> awaitedTime;
+	while (const std::optional<Scheduler::ScheduledEvent> event{m_scheduler.popDueEvent()})
+	{
+		const uint64_t frameLength{
+			Ricoh2C02::cyclesPerScanline * static_cast<uint64_t>(m_ppu->getScanlineCount()) * m_timing.m_masterCyclesPerPpuCycle};
+
+		// The PPU only runs when it is observed: on register access and at predicted events
+		m_ppu->catchUp(event->m_time / m_timing.m_masterCyclesPerPpuCycle);
+
+		switch (event->m_event)
 		{
-			m_ppu->step();
+		case Scheduler::Event::FrameEnd:
+			++m_frameCount;
+			[[fallthrough]];
+		case Scheduler::Event::VBlank:
+			m_scheduler.schedule(event->m_event, event->m_time + frameLength);
+			break;
 		}
 
-#if defined(LIBNES_LOG)
-		log << 
-			" CYC:" << std::setw(3) << std::setfill(' ') << std::right << std::dec << lastCycle << 
-			" SL:" << std::left << lastScanline << "\n";
-#endif
+		if (event->m_event == awaited)
+		{
+			awaitedTime = event->m_time;
+		}
+	}
+
+	// Also catches NMIs enabled by a PPUCTRL write while in vblank
+	if (m_ppu->pollNmi())
+	{
+		m_cpu->nmi();
 	}
-	std::this_thread::sleep_until(start + time);
+
+	return awaitedTime;
+}
+
+void Nes::scheduleFromPpu(Scheduler::Event event, int16_t scanline, uint16_t cycle)
+{
+	m_scheduler.schedule(
+		event, 
+		(m_ppu->getCycleCount() + m_ppu->getCyclesUntil(scanline, cycle)) * m_timing.m_masterCyclesPerPpuCycle);
 }
 
 } // namespace LibNes
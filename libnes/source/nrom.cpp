@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 
 #include "libnes/nrom.h"
@@ -7,74 +8,82 @@ namespace LibNes
 
 NRom::NRom(
 	NonNullSharedPtr<Cartridge::Rom> rom, 
-	const Mirroring& mirroring,
-	NonNullSharedPtr<std::vector<uint8_t>> vram) :
+	const Mirroring& mirroring) :
 	Mapper{rom, mirroring},
-	m_vram{vram}
+	m_prgRam(prgRamSize)
 {
+	// Nes::loadCartridge rejects images without PRG-ROM
+	assert(!m_rom->m_prgRom.empty());
 }
 
-uint8_t NRom::read(uint16_t address, Badge<CpuMemory>)
+NonNullSharedPtr<Mapper> NRom::clone() const
 {
-	uint8_t data{0};
+	return std::make_shared<NRom>(*this);
+}
 
-	assert(address >= 0x4020);
+void NRom::mapPrg()
+{
+	mapPrgRam(0x6000, m_prgRam.size(), m_prgRam.data());
 
-	if (address >= 0x6000 && address <= 0x7FFF) // TODO: PRG RAM
+	// 16 KiB images are mirrored into 0xC000 - 0xFFFF
+	const size_t prgRomSize{std::min<size_t>(m_rom->m_prgRom.size(), 0x8000)};
+	for (size_t address{0x8000}; prgRomSize > 0 && address <= 0xFFFF; address += prgRomSize)
 	{
-
+		mapPrgRom(address, prgRomSize, 0);
 	}
+}
 
-	else // PRG ROM
-	{
-		data = m_rom->m_prgRom[(address - 0x8000) % m_rom->m_prgRom.size()];
-	}
+void NRom::mapPpu()
+{
+	mapChrMemory(0x0000, std::min<size_t>(getChrSize(), 0x2000), 0);
+	mapNametables(m_mirroring);
+}
 
-	return data;
+size_t NRom::getStateSize() const
+{
+	return m_prgRam.size();
 }
 
-void NRom::write(uint16_t address, uint8_t data, Badge<CpuMemory>)
+void NRom::writeState(StateWriter& writer) const
 {
-	
+	writer.write(m_prgRam.data(), m_prgRam.size());
 }
 
-uint8_t NRom::read(uint16_t address, Badge<Ricoh2C02>)
+void NRom::readState(StateReader& reader)
+{
+	reader.read(m_prgRam.data(), m_prgRam.size());
+}
+
+uint8_t NRom::read(uint16_t address, Badge<CpuMemory>)
 {
 	uint8_t data{0};
 
-	if (address <= 0x1FFF)
+	assert(address >= 0x4020);
+
+	if (address < 0x6000) // Unmapped
 	{
-		data = m_rom->m_chrRom[address];
+
 	}
-	else if (address <= 0x2FFF)
+
+	else if (address <= 0x7FFF) // PRG RAM
 	{
-		if (m_mirroring == Mirroring::Horizontal)
-		{
-			if (address <= 0x27FF)
-			{
-				data = m_vram->data()[(address - 0x2000) % 0x400];
-			}
-			else
-			{
-				data = m_vram->data()[((address - 0x2800) % 0x400) + 0x800];
-			}
-		}
-		else if (m_mirroring == Mirroring::Vertical)
-		{
-			data = m_vram->data()[(address - 0x2000) % 0x800];
-		}
+		data = m_prgRam[address - 0x6000];
 	}
-	else if (address <= 0x3EFF)
+
+	else if (!m_rom->m_prgRom.empty()) // PRG ROM
 	{
-		// TODO: mirror 0x2000
+		data = m_rom->m_prgRom[(address - 0x8000) % m_rom->m_prgRom.size()];
 	}
 
 	return data;
 }
 
-void NRom::write(uint16_t address, uint8_t data, Badge<Ricoh2C02>)
+void NRom::write(uint16_t address, uint8_t data, Badge<CpuMemory>)
 {
-	
+	if (address >= 0x6000 && address <= 0x7FFF) // PRG RAM
+	{
+		m_prgRam[address - 0x6000] = data;
+	}
 }
 
 } // namespace LibNes
@@ -0,0 +1,152 @@
+#include <cstring>
+
+#include "libnes/palette_converter.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LIBNES_PALETTE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace LibNes
+{
+
+namespace
+{
+
+void convertScalar(
+	const uint8_t* source, 
+	size_t count, 
+	const uint32_t* table, 
+	PaletteConverter::Format format, 
+	uint8_t* destination)
+{
+	if (format == PaletteConverter::Format::Rgba8888)
+	{
+		for (size_t i{0}; i < count; ++i)
+		{
+			std::memcpy(destination + i * 4, &table[source[i] & 0x3F], 4);
+		}
+	}
+	else
+	{
+		for (size_t i{0}; i < count; ++i)
+		{
+			const auto pixel{static_cast<uint16_t>(table[source[i] & 0x3F])};
+			std::memcpy(destination + i * 2, &pixel, 2);
+		}
+	}
+}
+
+#if defined(LIBNES_PALETTE_AVX2)
+// Gathers eight table entries at a time. SSE2 has neither a gather nor a byte shuffle,
+// so CPUs without AVX2 use the scalar loop.
+__attribute__((target("avx2"))) void convertAvx2(
+	const uint8_t* source, 
+	size_t count, 
+	const uint32_t* table, 
+	PaletteConverter::Format format, 
+	uint8_t* destination)
+{
+	const __m256i indexMask{_mm256_set1_epi32(0x3F)};
+
+	size_t i{0};
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i indices{_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i)))};
+		indices = _mm256_and_si256(indices, indexMask);
+		const __m256i pixels{_mm256_i32gather_epi32(reinterpret_cast<const int*>(table), indices, 4)};
+
+		if (format == PaletteConverter::Format::Rgba8888)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i * 4), pixels);
+		}
+		else
+		{
+			// Packing works per 128 bit lane, so the two low quadwords are moved together afterwards
+			const __m256i packed{_mm256_permute4x64_epi64(_mm256_packus_epi32(pixels, pixels), 0x08)};
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 2), _mm256_castsi256_si128(packed));
+		}
+	}
+
+	convertScalar(source + i, count - i, table, format, destination + i * (format == PaletteConverter::Format::Rgba8888 ? 4 : 2));
+}
+#endif
+
+} // namespace
+
+PaletteConverter::PaletteConverter(Format format) :
+	m_format{format},
+	m_vectorized{false},
+	m_table{}
+{
+#if defined(LIBNES_PALETTE_AVX2)
+	m_vectorized = __builtin_cpu_supports("avx2");
+#endif
+
+	for (size_t emphasis{0}; emphasis < 8; ++emphasis)
+	{
+		for (size_t index{0}; index < Screen::palette.size(); ++index)
+		{
+			// Emphasis darkens the channels that are not emphasized; the grays in columns E and F stay black
+			float channels[3]{
+				static_cast<float>(Screen::palette[index].r), 
+				static_cast<float>(Screen::palette[index].g), 
+				static_cast<float>(Screen::palette[index].b)};
+			if (emphasis != 0 && (index & 0x0E) != 0x0E)
+			{
+				for (size_t channel{0}; channel < 3; ++channel)
+				{
+					if (!(emphasis & (1 << channel)))
+					{
+						channels[channel] *= 0.816f;
+					}
+				}
+			}
+
+			const auto r{static_cast<uint32_t>(channels[0])};
+			const auto g{static_cast<uint32_t>(channels[1])};
+			const auto b{static_cast<uint32_t>(channels[2])};
+			m_table[(emphasis << 6) | index] = format == Format::Rgba8888 ?
+				r | (g << 8) | (b << 16) | (0xFFu << 24) :
+				((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+		}
+	}
+}
+
+PaletteConverter::Format PaletteConverter::getFormat() const
+{
+	return m_format;
+}
+
+size_t PaletteConverter::getBytesPerPixel() const
+{
+	return m_format == Format::Rgba8888 ? 4 : 2;
+}
+
+void PaletteConverter::convert(std::span<const uint8_t> paletteIndices, uint8_t emphasis, uint8_t* destination) const
+{
+	const uint32_t* table{m_table.data() + ((emphasis & 0x07) << 6)};
+
+#if defined(LIBNES_PALETTE_AVX2)
+	if (m_vectorized)
+	{
+		convertAvx2(paletteIndices.data(), paletteIndices.size(), table, m_format, destination);
+		return;
+	}
+#endif
+
+	convertScalar(paletteIndices.data(), paletteIndices.size(), table, m_format, destination);
+}
+
+void PaletteConverter::convertFrame(
+	std::span<const uint8_t, Screen::width * Screen::height> frame, 
+	std::span<const uint8_t, Screen::height> emphasis, 
+	uint8_t* destination) const
+{
+	for (size_t y{0}; y < Screen::height; ++y)
+	{
+		convert(frame.subspan(y * Screen::width, Screen::width), emphasis[y], destination + y * Screen::width * getBytesPerPixel());
+	}
+}
+
+} // namespace LibNes
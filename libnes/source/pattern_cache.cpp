@@ -0,0 +1,78 @@
+#include <array>
+#include <cassert>
+
+#include "libnes/pattern_cache.h"
+
+namespace LibNes
+{
+
+namespace
+{
+
+// The bits of a bitplane byte spread to one byte per pixel, leftmost pixel in the lowest byte
+constexpr std::array<uint64_t, 256> planeRows{[]
+{
+	std::array<uint64_t, 256> rows{};
+	for (size_t plane{0}; plane < rows.size(); ++plane)
+	{
+		for (int pixel{0}; pixel < 8; ++pixel)
+		{
+			rows[plane] |= static_cast<uint64_t>((plane >> (7 - pixel)) & 1u) << (pixel * 8);
+		}
+	}
+	return rows;
+}()};
+
+}
+
+PatternCache::PatternCache(const std::vector<uint8_t>& chr) :
+	m_rows(chr.size() / bytesPerTile * rowsPerTile)
+{
+	for (size_t offset{0}; offset + bytesPerTile <= chr.size(); offset += bytesPerTile)
+	{
+		for (size_t row{0}; row < rowsPerTile; ++row)
+		{
+			update(chr, offset + row);
+		}
+	}
+}
+
+void PatternCache::update(const std::vector<uint8_t>& chr, size_t offset)
+{
+	// The low plane of a row is followed by its high plane 8 bytes later
+	const size_t low{offset & ~size_t{0x08}};
+	if (low + rowsPerTile < chr.size())
+	{
+		m_rows[getRowIndex(offset)] = decode(chr[low], chr[low + rowsPerTile]);
+	}
+}
+
+const uint64_t* PatternCache::getRows(size_t offset) const
+{
+	assert(offset % bytesPerTile == 0 && getRowIndex(offset) < m_rows.size());
+	return m_rows.data() + getRowIndex(offset);
+}
+
+uint64_t PatternCache::decode(uint8_t low, uint8_t high)
+{
+	return planeRows[low] | (planeRows[high] << 1);
+}
+
+uint64_t PatternCache::flip(uint64_t row)
+{
+	row = ((row & 0x00FF00FF00FF00FFull) << 8) | ((row >> 8) & 0x00FF00FF00FF00FFull);
+	row = ((row & 0x0000FFFF0000FFFFull) << 16) | ((row >> 16) & 0x0000FFFF0000FFFFull);
+	return (row << 32) | (row >> 32);
+}
+
+uint64_t PatternCache::getOpaqueMask(uint64_t row)
+{
+	return ((row | (row >> 1)) & 0x0101010101010101ull) * 0xFF;
+}
+
+size_t PatternCache::getRowIndex(size_t offset)
+{
+	return offset / bytesPerTile * rowsPerTile + offset % rowsPerTile;
+}
+
+} // namespace LibNes
@@ -0,0 +1,75 @@
+#include "libnes/ppu_renderer.h"
+
+namespace LibNes
+{
+
+PpuRenderer::PpuRenderer(NonNullSharedPtr<Screen> screen) :
+	m_ppu{makeNonNullUnique<Ricoh2C02>(screen)},
+	m_events{},
+	m_pushed{0},
+	m_replayed{0},
+	m_thread{&PpuRenderer::run, this}
+{
+}
+
+PpuRenderer::~PpuRenderer()
+{
+	push(PpuEvent{0, PpuEvent::Kind::Stop, 0, 0, 0, 0, nullptr, nullptr});
+	m_thread.join();
+}
+
+void PpuRenderer::push(const PpuEvent& event)
+{
+	while (!m_events.tryPush(event))
+	{
+		m_events.notify();
+		std::this_thread::yield();
+	}
+	++m_pushed;
+
+	// The renderer is only woken once per frame
+	if (event.m_kind == PpuEvent::Kind::FrameEnd || event.m_kind == PpuEvent::Kind::Stop)
+	{
+		m_events.notify();
+	}
+}
+
+void PpuRenderer::finish()
+{
+	m_events.notify();
+	while (m_replayed.load(std::memory_order_acquire) != m_pushed)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void PpuRenderer::loadState(const Ricoh2C02::State& state)
+{
+	// The renderer thread waits for events now. It sees the loaded state through the release of
+	// the next push.
+	finish();
+	m_ppu->loadState(state);
+}
+
+void PpuRenderer::run()
+{
+	PpuEvent event;
+	while (true)
+	{
+		if (!m_events.tryPop(event))
+		{
+			m_events.wait();
+			continue;
+		}
+
+		if (event.m_kind == PpuEvent::Kind::Stop)
+		{
+			break;
+		}
+
+		m_ppu->replay(event, Badge<PpuRenderer>{});
+		m_replayed.store(m_replayed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+}
+
+} // namespace LibNes
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+#include "libnes/nes.h"
+#include "libnes/rewind_buffer.h"
+
+namespace LibNes
+{
+
+namespace
+{
+
+// Every token starts with a byte holding its length - 1 in the low bits. Zero runs have the top
+// bit set, literals are followed by their bytes.
+constexpr uint8_t zeroRunToken{0x80};
+constexpr size_t maxTokenLength{0x80};
+// Shorter runs of zeros cost less inside a literal than as two more tokens
+constexpr size_t minZeroRun{3};
+
+size_t countZeros(std::span<const uint8_t> data, size_t position)
+{
+	const size_t start{position};
+	uint64_t word;
+	while (position + sizeof(word) <= data.size())
+	{
+		std::memcpy(&word, data.data() + position, sizeof(word));
+		if (word != 0)
+		{
+			const int zeroBits{std::endian::native == std::endian::little ? std::countr_zero(word) : std::countl_zero(word)};
+			return position + zeroBits / 8 - start;
+		}
+		position += sizeof(word);
+	}
+
+	while (position < data.size() && data[position] == 0)
+	{
+		++position;
+	}
+	return position - start;
+}
+
+// A word at a time, a loop over bytes isn't vectorized and takes ten times as long
+void xorBytes(std::span<const uint8_t> left, std::span<const uint8_t> right, std::span<uint8_t> output)
+{
+	size_t index{0};
+	for (; index + sizeof(uint64_t) <= output.size(); index += sizeof(uint64_t))
+	{
+		uint64_t leftWord;
+		uint64_t rightWord;
+		std::memcpy(&leftWord, left.data() + index, sizeof(leftWord));
+		std::memcpy(&rightWord, right.data() + index, sizeof(rightWord));
+		leftWord ^= rightWord;
+		std::memcpy(output.data() + index, &leftWord, sizeof(leftWord));
+	}
+
+	for (; index < output.size(); ++index)
+	{
+		output[index] = left[index] ^ right[index];
+	}
+}
+
+}
+
+RewindBuffer::RewindBuffer(size_t capacity, uint32_t keyframeInterval) :
+	m_ring(capacity),
+	m_head{0},
+	m_keyframeInterval{std::max<uint32_t>(keyframeInterval, 1)},
+	m_statistics{0, 0, 0, 0, 0, std::chrono::nanoseconds{0}, std::chrono::nanoseconds{0}}
+{
+
+}
+
+bool RewindBuffer::capture(const Nes& nes)
+{
+	const auto start{std::chrono::steady_clock::now()};
+
+	nes.saveState(m_state);
+	if (m_state.size() != m_statistics.m_stateSize)
+	{
+		// The stored states are of another cartridge
+		clear();
+		m_statistics.m_stateSize = m_state.size();
+	}
+
+	bool keyframe{m_entries.empty() || m_entries.back().m_framesSinceKeyframe + 1 >= m_keyframeInterval};
+	if (keyframe)
+	{
+		compress(m_state, m_compressed);
+	}
+	else
+	{
+		m_delta.resize(m_state.size());
+		xorBytes(m_state, m_keyframe, m_delta);
+		compress(m_delta, m_compressed);
+	}
+
+	if (m_compressed.size() > m_ring.size())
+	{
+		clear();
+		return false;
+	}
+	size_t offset{allocate(m_compressed.size())};
+
+	if (!keyframe && m_entries.empty())
+	{
+		// Making room dropped the keyframe of the delta
+		keyframe = true;
+		compress(m_state, m_compressed);
+		if (m_compressed.size() > m_ring.size())
+		{
+			return false;
+		}
+		offset = allocate(m_compressed.size());
+	}
+
+	std::memcpy(m_ring.data() + offset, m_compressed.data(), m_compressed.size());
+	m_head = offset + m_compressed.size();
+
+	Entry entry{offset, m_compressed.size(), 0, offset, m_compressed.size()};
+	if (keyframe)
+	{
+		std::swap(m_keyframe, m_state);
+		++m_statistics.m_keyframes;
+	}
+	else
+	{
+		const Entry& previous{m_entries.back()};
+		entry.m_framesSinceKeyframe = previous.m_framesSinceKeyframe + 1;
+		entry.m_keyframeOffset = previous.m_keyframeOffset;
+		entry.m_keyframeSize = previous.m_keyframeSize;
+	}
+	m_entries.push_back(entry);
+	m_statistics.m_storedBytes += entry.m_size;
+
+	++m_statistics.m_capturedFrames;
+	m_statistics.m_lastCaptureTime = std::chrono::steady_clock::now() - start;
+	m_statistics.m_captureTime += m_statistics.m_lastCaptureTime;
+	return true;
+}
+
+bool RewindBuffer::rewind(Nes& nes)
+{
+	if (m_entries.empty())
+	{
+		return false;
+	}
+
+	const Entry entry{m_entries.back()};
+	if (entry.m_framesSinceKeyframe == 0)
+	{
+		m_state.assign(m_statistics.m_stateSize, 0);
+	}
+	else
+	{
+		m_state.assign(m_keyframe.begin(), m_keyframe.end());
+	}
+	decompress({m_ring.data() + entry.m_offset, entry.m_size}, m_state);
+
+	if (!nes.loadState(m_state))
+	{
+		return false;
+	}
+
+	m_entries.pop_back();
+	m_statistics.m_storedBytes -= entry.m_size;
+	m_head = m_entries.empty() ? 0 : entry.m_offset;
+
+	// Further deltas are against the keyframe of the previous group
+	if (entry.m_framesSinceKeyframe == 0 && !m_entries.empty())
+	{
+		const Entry& previous{m_entries.back()};
+		m_keyframe.assign(m_statistics.m_stateSize, 0);
+		decompress({m_ring.data() + previous.m_keyframeOffset, previous.m_keyframeSize}, m_keyframe);
+	}
+
+	return true;
+}
+
+void RewindBuffer::clear()
+{
+	m_entries.clear();
+	m_head = 0;
+	m_statistics.m_storedBytes = 0;
+}
+
+size_t RewindBuffer::getFrameCount() const
+{
+	return m_entries.size();
+}
+
+size_t RewindBuffer::getCapacity() const
+{
+	return m_ring.size();
+}
+
+RewindBuffer::Statistics RewindBuffer::getStatistics() const
+{
+	Statistics statistics{m_statistics};
+	statistics.m_storedFrames = m_entries.size();
+	return statistics;
+}
+
+void RewindBuffer::compress(std::span<const uint8_t> data, std::vector<uint8_t>& compressed)
+{
+	compressed.clear();
+
+	size_t position{0};
+	while (position < data.size())
+	{
+		size_t zeros{countZeros(data, position)};
+		if (zeros >= minZeroRun || position + zeros == data.size())
+		{
+			position += zeros;
+			while (zeros > 0)
+			{
+				const size_t length{std::min(zeros, maxTokenLength)};
+				compressed.push_back(static_cast<uint8_t>(zeroRunToken | (length - 1)));
+				zeros -= length;
+			}
+			continue;
+		}
+
+		// A literal up to the next run of zeros worth a token of its own
+		const size_t start{position};
+		const size_t end{std::min(start + maxTokenLength, data.size())};
+		position += zeros;
+		while (position < end)
+		{
+			if (data[position] != 0)
+			{
+				++position;
+				continue;
+			}
+
+			zeros = countZeros(data, position);
+			if (zeros >= minZeroRun || position + zeros == data.size())
+			{
+				break;
+			}
+			position += zeros;
+		}
+		position = std::min(position, end);
+
+		compressed.push_back(static_cast<uint8_t>(position - start - 1));
+		compressed.insert(compressed.end(), data.begin() + start, data.begin() + position);
+	}
+}
+
+void RewindBuffer::decompress(std::span<const uint8_t> compressed, std::span<uint8_t> output)
+{
+	size_t position{0};
+	size_t index{0};
+	while (index < compressed.size())
+	{
+		const uint8_t token{compressed[index++]};
+		const size_t length{static_cast<size_t>(token & ~zeroRunToken) + 1};
+		if (!(token & zeroRunToken))
+		{
+			assert(index + length <= compressed.size() && position + length <= output.size());
+			for (size_t offset{0}; offset < length; ++offset)
+			{
+				output[position + offset] ^= compressed[index + offset];
+			}
+			index += length;
+		}
+		position += length;
+	}
+	assert(position == output.size());
+}
+
+size_t RewindBuffer::allocate(size_t size)
+{
+	size_t offset{m_head};
+	if (offset + size > m_ring.size())
+	{
+		// Entries don't wrap around, the rest of the ring stays unused for now. Everything
+		// behind the head is older than what is in front of it.
+		while (!m_entries.empty() && m_entries.front().m_offset >= m_head)
+		{
+			dropOldest();
+		}
+		offset = 0;
+	}
+
+	while (!m_entries.empty() &&
+		m_entries.front().m_offset < offset + size &&
+		m_entries.front().m_offset + m_entries.front().m_size > offset)
+	{
+		dropOldest();
+	}
+
+	return offset;
+}
+
+void RewindBuffer::dropOldest()
+{
+	// Deltas can't be restored without their keyframe
+	do
+	{
+		m_statistics.m_storedBytes -= m_entries.front().m_size;
+		m_entries.pop_front();
+	}
+	while (!m_entries.empty() && m_entries.front().m_framesSinceKeyframe != 0);
+}
+
+std::chrono::nanoseconds RewindBuffer::Statistics::getAverageCaptureTime() const
+{
+	return m_capturedFrames > 0 ? m_captureTime / static_cast<int64_t>(m_capturedFrames) : std::chrono::nanoseconds{0};
+}
+
+double RewindBuffer::Statistics::getCompressionRatio() const
+{
+	return m_storedBytes > 0 ? static_cast<double>(m_storedFrames * m_stateSize) / m_storedBytes : 0;
+}
+
+} // namespace LibNes
@@ -1,33 +1,534 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+#include "libnes/ppu_renderer.h"
 #include "libnes/ricoh_2c02.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace LibNes
 {
 
+namespace
+{
+
+// Bits of the sprite line next to the palette RAM index
+constexpr uint8_t spritePalettes{0x10};
+constexpr uint8_t spriteBehind{0x20};
+constexpr uint8_t spriteZero{0x40};
+constexpr uint8_t spriteIndex{0x1F};
+
+// Pattern rows keep the leftmost pixel in the lowest byte
+uint64_t loadPixels(const uint8_t* pixels)
+{
+    uint64_t row;
+    std::memcpy(&row, pixels, sizeof(row));
+    return std::endian::native == std::endian::little ? row : PatternCache::flip(row);
+}
+
+void storePixels(uint8_t* pixels, uint64_t row)
+{
+    row = std::endian::native == std::endian::little ? row : PatternCache::flip(row);
+    std::memcpy(pixels, &row, sizeof(row));
+}
+
+// Replaces background pixels with sprite pixels unless the sprite pixel is transparent, or behind
+// an opaque background pixel. Returns true if an opaque pixel of sprite 0 overlaps an opaque
+// background pixel, which never happens at x = 255.
+bool composite(uint8_t* line, const uint8_t* sprites)
+{
+    size_t x{0};
+    bool hit{false};
+
+#if defined(__SSE2__)
+    const __m128i zero{_mm_setzero_si128()};
+    const __m128i colorBits{_mm_set1_epi8(0x03)};
+    const __m128i behindBit{_mm_set1_epi8(spriteBehind)};
+    const __m128i zeroBit{_mm_set1_epi8(spriteZero)};
+    const __m128i indexBits{_mm_set1_epi8(spriteIndex)};
+
+    int hits{0};
+    for (; x < Screen::width; x += 16)
+    {
+        const __m128i background{_mm_loadu_si128(reinterpret_cast<const __m128i*>(line + x))};
+        const __m128i sprite{_mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x))};
+
+        const __m128i backgroundTransparent{_mm_cmpeq_epi8(_mm_and_si128(background, colorBits), zero)};
+        const __m128i spriteTransparent{_mm_cmpeq_epi8(sprite, zero)};
+        const __m128i inFront{_mm_cmpeq_epi8(_mm_and_si128(sprite, behindBit), zero)};
+        const __m128i showSprite{_mm_andnot_si128(spriteTransparent, _mm_or_si128(inFront, backgroundTransparent))};
+
+        const __m128i pixels{_mm_or_si128(
+            _mm_and_si128(showSprite, _mm_and_si128(sprite, indexBits)), 
+            _mm_andnot_si128(showSprite, background))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(line + x), pixels);
+
+        const __m128i noSpriteZero{_mm_cmpeq_epi8(_mm_and_si128(sprite, zeroBit), zero)};
+        int overlap{~_mm_movemask_epi8(_mm_or_si128(noSpriteZero, backgroundTransparent)) & 0xFFFF};
+        if (x + 16 == Screen::width)
+        {
+            overlap &= 0x7FFF;
+        }
+        hits |= overlap;
+    }
+
+    hit = hits != 0;
+#endif
+
+    for (; x < Screen::width; ++x)
+    {
+        const uint8_t sprite{sprites[x]};
+        const bool backgroundOpaque{(line[x] & 0x03) != 0};
+        if (sprite != 0 && (!(sprite & spriteBehind) || !backgroundOpaque))
+        {
+            line[x] = sprite & spriteIndex;
+        }
+        hit |= (sprite & spriteZero) && backgroundOpaque && x != Screen::width - 1;
+    }
+
+    return hit;
+}
+
+} // namespace
+
 Ricoh2C02::Ricoh2C02(NonNullSharedPtr<Screen> screen) : 
     m_scanline{scanlineDefault},
     m_cycle{cycleDefault},
+    m_cycleCount{0},
+    m_frameCount{0},
+    m_region{Region::Ntsc},
+    m_scanlineCount{getRegionTiming(Region::Ntsc).m_scanlineCount},
+    m_vblankScanline{getRegionTiming(Region::Ntsc).m_vblankScanline},
     m_screen{screen},
-    m_objectAttributeMemory{objectAttributeMemorySize, std::allocator<uint8_t>{}}
+    m_renderer{nullptr},
+    m_control{0},
+    m_mask{0},
+    m_status{0},
+    m_oamAddress{0},
+    m_latch{0},
+    m_readBuffer{0},
+    m_nmiRequested{false},
+    m_v{0},
+    m_t{0},
+    m_x{0},
+    m_w{false},
+    m_objectAttributeMemory{objectAttributeMemorySize, std::allocator<uint8_t>{}},
+    m_lineSprites{},
+    m_lineSpriteCount{0},
+    m_spriteLimit{true},
+    m_outputEnabled{true},
+    m_spriteLine{},
+    m_chrPages{},
+    m_patternPages{},
+    m_chrRamOffsets{},
+    m_nametables{},
+    m_chrRam{},
+    m_chrRamPatterns{m_chrRam},
+    m_vram{},
+    m_paletteRam{},
+    m_frameBuffer{},
+    m_emphasis{}
 {
+    m_chrRamOffsets.fill(noChrRam);
+    for (size_t slot{0}; slot < m_nametables.size(); ++slot)
+    {
+        m_nametables[slot] = m_vram.data();
+    }
+}
+
+Ricoh2C02::Ricoh2C02(const Ricoh2C02& other, NonNullSharedPtr<Screen> screen, NonNullSharedPtr<Mapper> mapper, Badge<Nes>) :
+    m_scanline{other.m_scanline},
+    m_cycle{other.m_cycle},
+    m_cycleCount{other.m_cycleCount},
+    m_frameCount{other.m_frameCount},
+    m_region{other.m_region},
+    m_scanlineCount{other.m_scanlineCount},
+    m_vblankScanline{other.m_vblankScanline},
+    m_screen{screen},
+    m_mapper{mapper},
+    m_renderer{nullptr},
+    m_control{other.m_control},
+    m_mask{other.m_mask},
+    m_status{other.m_status},
+    m_oamAddress{other.m_oamAddress},
+    m_latch{other.m_latch},
+    m_readBuffer{other.m_readBuffer},
+    m_nmiRequested{other.m_nmiRequested},
+    m_v{other.m_v},
+    m_t{other.m_t},
+    m_x{other.m_x},
+    m_w{other.m_w},
+    m_objectAttributeMemory{other.m_objectAttributeMemory},
+    m_lineSprites{},
+    m_lineSpriteCount{0},
+    m_spriteLimit{other.m_spriteLimit},
+    m_outputEnabled{true},
+    m_spriteLine{},
+    m_chrPages{other.m_chrPages},
+    m_patternPages{other.m_patternPages},
+    m_chrRamOffsets{other.m_chrRamOffsets},
+    m_nametables{},
+    m_chrRam{other.m_chrRam},
+    m_chrRamPatterns{other.m_chrRamPatterns},
+    m_vram{other.m_vram},
+    m_paletteRam{other.m_paletteRam},
+    m_frameBuffer{},
+    m_emphasis{other.m_emphasis}
+{
+    // CHR-ROM stays mapped where it is, CHR-RAM and the nametables move into this PPU
+    for (size_t page{0}; page < m_chrPages.size(); ++page)
+    {
+        if (m_chrRamOffsets[page] != noChrRam)
+        {
+            m_chrPages[page] = m_chrRam.data() + m_chrRamOffsets[page];
+            m_patternPages[page] = m_chrRamPatterns.getRows(m_chrRamOffsets[page]);
+        }
+    }
+    for (size_t slot{0}; slot < m_nametables.size(); ++slot)
+    {
+        m_nametables[slot] = m_vram.data() + (other.m_nametables[slot] - other.m_vram.data());
+    }
+
+    mapper->attachCopy(*this, Badge<Ricoh2C02>{});
 }
 
 void Ricoh2C02::step()
 {
-    static uint64_t time = 0;
-    Screen::Pixel pixel;
-    pixel.position = {m_cycle, static_cast<uint16_t>(m_scanline)};
-    pixel.color = { static_cast<uint8_t>((m_cycle / 340.f) * 0xFF), static_cast<uint8_t>(time), static_cast<uint8_t>((m_scanline / 260.f) * 0xFF) };
-    m_screen->draw(pixel);
+    runCycle(m_cycle);
+
+    ++m_cycleCount;
     ++m_cycle;
-    if (m_cycle > 340)
+    if (m_cycle >= cyclesPerScanline)
     {
-        m_cycle = 0;
+        nextScanline();
+    }
+}
 
-        ++m_scanline;
-        if (m_scanline > 260)
+// Produces the same state as stepping through the whole scanline
+void Ricoh2C02::renderScanline()
+{
+    for (const uint16_t cycle : {1, 256, 257, 280})
+    {
+        runCycle(cycle);
+    }
+
+    m_cycleCount += cyclesPerScanline;
+    nextScanline();
+}
+
+// The renderer works on whole scanlines, so only a few cycles have an effect
+void Ricoh2C02::runCycle(uint16_t cycle)
+{
+    switch (cycle)
+    {
+    case 1:
+        updateFlags();
+        break;
+    case 256:
+        if (m_scanline >= 0 && m_scanline < postRenderScanline)
+        {
+            renderLine();
+            if (isRenderingEnabled())
+            {
+                incrementY();
+            }
+        }
+        break;
+    case 257:
+        if ((m_scanline < postRenderScanline) && isRenderingEnabled())
         {
-            m_scanline = -1;
-            time++;
+            copyX();
+        }
+        break;
+    case 280:
+        if (m_scanline == preRenderScanline && isRenderingEnabled())
+        {
+            copyY();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Flags change on cycle 1 of their scanline
+void Ricoh2C02::updateFlags()
+{
+    if (m_scanline == m_vblankScanline)
+    {
+        m_status |= StatusBits::VBlank;
+        m_nmiRequested |= static_cast<bool>(m_control & ControlBits::NmiEnable);
+    }
+    else if (m_scanline == preRenderScanline)
+    {
+        m_status &= ~(StatusBits::VBlank | StatusBits::SpriteZeroHit | StatusBits::SpriteOverflow);
+    }
+}
+
+void Ricoh2C02::renderLine()
+{
+    if (m_frameBuffer.empty())
+    {
+        m_frameBuffer.resize(Screen::width * Screen::height);
+    }
+    uint8_t* const line{m_frameBuffer.data() + m_scanline * Screen::width};
+
+    m_lineSpriteCount = 0;
+    if (isRenderingEnabled())
+    {
+        evaluateSprites();
+    }
+
+    // Only sprite 0 hits are needed if the renderer draws the picture or the frame is hidden
+    if (m_renderer || !m_outputEnabled)
+    {
+        const uint8_t layers{MaskBits::ShowBackground | MaskBits::ShowSprites};
+        if ((m_mask & layers) == layers && isSpriteZeroOnLine())
+        {
+            renderBackground(line);
+            renderSprites();
+            if (composite(line, m_spriteLine.data()))
+            {
+                m_status |= StatusBits::SpriteZeroHit;
+            }
+        }
+        return;
+    }
+
+    renderBackground(line);
+
+    if ((m_mask & MaskBits::ShowSprites) && m_lineSpriteCount > 0)
+    {
+        renderSprites();
+        if (composite(line, m_spriteLine.data()))
+        {
+            m_status |= StatusBits::SpriteZeroHit;
+        }
+    }
+
+    const uint8_t colorMask{static_cast<uint8_t>(m_mask & MaskBits::Grayscale ? 0x30 : 0x3F)};
+    for (size_t x{0}; x < Screen::width; ++x)
+    {
+        line[x] = m_paletteRam[line[x]] & colorMask;
+    }
+
+    m_emphasis[m_scanline] = (m_mask & MaskBits::Emphasis) >> 5;
+    m_screen->drawScanline(m_scanline, std::span<const uint8_t, Screen::width>{line, Screen::width}, m_emphasis[m_scanline]);
+}
+
+void Ricoh2C02::renderBackground(uint8_t* line)
+{
+    if (!(m_mask & MaskBits::ShowBackground))
+    {
+        std::fill(line, line + Screen::width, 0);
+        return;
+    }
+
+    const uint16_t patternTable{static_cast<uint16_t>(m_control & ControlBits::BackgroundTable ? 0x1000 : 0)};
+    const uint16_t fineY{static_cast<uint16_t>(m_v >> 12)};
+
+    // 33 tiles cover the scanline for every fine x scroll
+    std::array<uint8_t, (Screen::width / 8 + 1) * 8> tiles;
+    uint16_t v{m_v};
+    for (size_t tile{0}; tile <= Screen::width / 8; ++tile)
+    {
+        const uint8_t* const nametable{m_nametables[(v >> 10) & 0x03]};
+        const uint8_t tileIndex{nametable[v & 0x03FF]};
+        const uint8_t attribute{nametable[0x03C0 | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)]};
+        const uint64_t palette{(attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03u};
+        const uint64_t pattern{getPatternRow(patternTable + tileIndex * 16 + fineY)};
+        storePixels(tiles.data() + tile * 8, (pattern | palette * 0x0404040404040404ull) & PatternCache::getOpaqueMask(pattern));
+
+        incrementX(v);
+    }
+
+    std::copy_n(tiles.data() + m_x, Screen::width, line);
+    if (!(m_mask & MaskBits::ShowBackgroundLeft))
+    {
+        std::fill(line, line + 8, 0);
+    }
+}
+
+// Sprite evaluation for the whole scanline. The hardware evaluates during the previous scanline,
+// which is why sprites appear one line below their Y coordinate. The overflow flag is set when
+// more than 8 sprites are found, without the diagonal OAM scan bug of the hardware.
+void Ricoh2C02::evaluateSprites()
+{
+    const int height{m_control & ControlBits::SpriteSize ? 16 : 8};
+    const size_t limit{m_spriteLimit ? spritesPerScanline : objectCount};
+
+    size_t found{0};
+    for (size_t sprite{0}; sprite < objectCount; ++sprite)
+    {
+        const uint8_t* const object{m_objectAttributeMemory.data() + sprite * 4};
+        int row{m_scanline - 1 - object[0]};
+        if (row < 0 || row >= height)
+        {
+            continue;
+        }
+
+        if (++found > spritesPerScanline)
+        {
+            m_status |= StatusBits::SpriteOverflow;
+            if (m_lineSpriteCount == limit)
+            {
+                break;
+            }
+        }
+
+        if (m_lineSpriteCount == limit)
+        {
+            continue;
+        }
+
+        const uint8_t attributes{object[2]};
+        if (attributes & AttributeBits::FlipVertical)
+        {
+            row = height - 1 - row;
+        }
+
+        // 8x16 sprites select the pattern table with bit 0 of the tile index
+        const uint16_t address{static_cast<uint16_t>(height == 16 ?
+            ((object[1] & 0x01) << 12) | ((object[1] & 0xFE) << 4) | ((row & 0x08) << 1) | (row & 0x07) :
+            (m_control & ControlBits::SpriteTable ? 0x1000 : 0) | (object[1] << 4) | row)};
+
+        uint64_t pattern{getPatternRow(address)};
+        if (attributes & AttributeBits::FlipHorizontal)
+        {
+            pattern = PatternCache::flip(pattern);
+        }
+
+        const uint64_t tag{static_cast<uint64_t>(
+            spritePalettes | 
+            ((attributes & AttributeBits::Palette) << 2) | 
+            (attributes & AttributeBits::BehindBackground ? spriteBehind : 0) | 
+            (sprite == 0 ? spriteZero : 0))};
+        const uint64_t mask{PatternCache::getOpaqueMask(pattern)};
+        m_lineSprites[m_lineSpriteCount++] = LineSprite{(pattern | tag * 0x0101010101010101ull) & mask, mask, object[3]};
+    }
+}
+
+// Merges the sprites 8 pixels at a time. Going backwards lets sprites with a lower OAM index
+// overwrite the ones behind them, whether they are in front of the background or not.
+void Ricoh2C02::renderSprites()
+{
+    m_spriteLine.fill(0);
+    for (size_t sprite{m_lineSpriteCount}; sprite-- > 0;)
+    {
+        const LineSprite& lineSprite{m_lineSprites[sprite]};
+        uint8_t* const pixels{m_spriteLine.data() + lineSprite.m_x};
+        storePixels(pixels, (loadPixels(pixels) & ~lineSprite.m_mask) | lineSprite.m_pixels);
+    }
+
+    if (!(m_mask & MaskBits::ShowSpritesLeft))
+    {
+        std::fill(m_spriteLine.begin(), m_spriteLine.begin() + 8, 0);
+    }
+}
+
+bool Ricoh2C02::isRenderingEnabled() const
+{
+    return m_mask & (MaskBits::ShowBackground | MaskBits::ShowSprites);
+}
+
+// Sprite 0 is first in the list if it is on the line at all
+bool Ricoh2C02::isSpriteZeroOnLine() const
+{
+    return m_lineSpriteCount > 0 && (m_lineSprites[0].m_pixels & (spriteZero * 0x0101010101010101ull));
+}
+
+void Ricoh2C02::incrementX(uint16_t& v) const
+{
+    if ((v & 0x001F) == 31)
+    {
+        v &= ~0x001F;
+        v ^= 0x0400; // next horizontal nametable
+    }
+    else
+    {
+        ++v;
+    }
+}
+
+void Ricoh2C02::incrementY()
+{
+    if ((m_v & 0x7000) != 0x7000)
+    {
+        m_v += 0x1000;
+        return;
+    }
+
+    m_v &= ~0x7000;
+    uint16_t coarseY{static_cast<uint16_t>((m_v & 0x03E0) >> 5)};
+    if (coarseY == 29)
+    {
+        coarseY = 0;
+        m_v ^= 0x0800; // next vertical nametable
+    }
+    else if (coarseY == 31)
+    {
+        coarseY = 0; // attribute rows wrap without switching nametables
+    }
+    else
+    {
+        ++coarseY;
+    }
+    m_v = (m_v & ~0x03E0) | (coarseY << 5);
+}
+
+void Ricoh2C02::copyX()
+{
+    m_v = (m_v & ~0x041F) | (m_t & 0x041F);
+}
+
+void Ricoh2C02::copyY()
+{
+    m_v = (m_v & ~0x7BE0) | (m_t & 0x7BE0);
+}
+
+void Ricoh2C02::nextScanline()
+{
+    m_cycle = 0;
+
+    ++m_scanline;
+    if (m_scanline == postRenderScanline)
+    {
+        if (m_renderer)
+        {
+            record(PpuEvent{m_cycleCount, PpuEvent::Kind::FrameEnd, 0, 0, 0, 0, nullptr, nullptr});
+        }
+        else if (m_outputEnabled)
+        {
+            m_screen->present();
+        }
+    }
+    else if (m_scanline >= preRenderScanline + m_scanlineCount)
+    {
+        m_scanline = preRenderScanline;
+        ++m_frameCount;
+    }
+}
+
+uint64_t Ricoh2C02::getCycleCount() const
+{
+    return m_cycleCount;
+}
+
+void Ricoh2C02::catchUp(uint64_t cycleCount)
+{
+    while (m_cycleCount < cycleCount)
+    {
+        if (m_cycle == 0 && cycleCount - m_cycleCount >= cyclesPerScanline)
+        {
+            renderScanline();
+        }
+        else
+        {
+            step();
         }
     }
 }
@@ -45,15 +546,91 @@ int16_t Ricoh2C02::getScanline()
 void Ricoh2C02::setMapper(NonNullSharedPtr<Mapper> mapper)
 {
     m_mapper = mapper;
+    mapper->attach(*this, Badge<Ricoh2C02>{});
+}
+
+void Ricoh2C02::allocateChrRam(size_t size, Badge<Mapper>)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::AllocateChrRam, 0, 0, size, 0, nullptr, nullptr});
+    allocateChrRam(size);
+}
+
+void Ricoh2C02::mapChrRom(uint16_t address, size_t size, const uint8_t* data, const uint64_t* rows, Badge<Mapper>)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::MapChrRom, 0, address, size, 0, data, rows});
+    mapChrRom(address, size, data, rows);
+}
+
+void Ricoh2C02::mapChrRam(uint16_t address, size_t size, size_t offset, Badge<Mapper>)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::MapChrRam, 0, address, size, offset, nullptr, nullptr});
+    mapChrRam(address, size, offset);
+}
+
+void Ricoh2C02::mapNametable(size_t slot, size_t page, Badge<Mapper>)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::MapNametable, 0, 0, slot, page, nullptr, nullptr});
+    mapNametable(slot, page);
+}
+
+void Ricoh2C02::allocateChrRam(size_t size)
+{
+    m_chrRam.assign(size, 0);
+    m_chrRamPatterns = PatternCache{m_chrRam};
+}
+
+void Ricoh2C02::mapChrRom(uint16_t address, size_t size, const uint8_t* data, const uint64_t* rows)
+{
+    assert(address % ppuPageSize == 0 && size % ppuPageSize == 0 && address + size <= 0x2000);
+
+    for (size_t offset{0}; offset < size; offset += ppuPageSize)
+    {
+        m_chrPages[(address + offset) / ppuPageSize] = data + offset;
+        m_patternPages[(address + offset) / ppuPageSize] = rows + offset / PatternCache::bytesPerTile * PatternCache::rowsPerTile;
+        m_chrRamOffsets[(address + offset) / ppuPageSize] = noChrRam;
+    }
+}
+
+void Ricoh2C02::mapChrRam(uint16_t address, size_t size, size_t offset)
+{
+    assert(address % ppuPageSize == 0 && size % ppuPageSize == 0 && address + size <= 0x2000);
+    assert(offset + size <= m_chrRam.size());
+
+    for (size_t pageOffset{0}; pageOffset < size; pageOffset += ppuPageSize)
+    {
+        m_chrPages[(address + pageOffset) / ppuPageSize] = m_chrRam.data() + offset + pageOffset;
+        m_patternPages[(address + pageOffset) / ppuPageSize] = m_chrRamPatterns.getRows(offset + pageOffset);
+        m_chrRamOffsets[(address + pageOffset) / ppuPageSize] = offset + pageOffset;
+    }
+}
+
+void Ricoh2C02::mapNametable(size_t slot, size_t page)
+{
+    m_nametables[slot] = m_vram.data() + page * ppuPageSize;
+}
+
+uint64_t Ricoh2C02::getPatternRow(uint16_t address) const
+{
+    const size_t offset{address % ppuPageSize};
+    return m_patternPages[address / ppuPageSize][offset / PatternCache::bytesPerTile * PatternCache::rowsPerTile + offset % PatternCache::rowsPerTile];
 }
 
 uint8_t Ricoh2C02::read(uint16_t address) const
 {
     uint8_t data{0};
 
-    if (address <= 0x2FFF)
+    address &= 0x3FFF;
+    if (address <= 0x1FFF) // Pattern tables
     {
-        data = m_mapper.value()->read(address, Badge<Ricoh2C02>{});
+        data = m_chrPages[address / ppuPageSize][address % ppuPageSize];
+    }
+    else if (address <= 0x3EFF) // Nametables, 0x3000 - 0x3EFF mirrors 0x2000 - 0x2EFF
+    {
+        data = m_nametables[(address / ppuPageSize) & 0x03][address % ppuPageSize];
+    }
+    else // Palette RAM
+    {
+        data = m_paletteRam[getPaletteIndex(address)];
     }
 
     return data;
@@ -61,7 +638,365 @@ uint8_t Ricoh2C02::read(uint16_t address) const
 
 void Ricoh2C02::write(uint16_t address, uint8_t data)
 {
+    address &= 0x3FFF;
+    if (address <= 0x1FFF) // Pattern tables, writes to CHR-ROM are ignored
+    {
+        const size_t offset{m_chrRamOffsets[address / ppuPageSize]};
+        if (offset != noChrRam)
+        {
+            m_chrRam[offset + address % ppuPageSize] = data;
+            m_chrRamPatterns.update(m_chrRam, offset + address % ppuPageSize);
+        }
+    }
+    else if (address <= 0x3EFF) // Nametables
+    {
+        m_nametables[(address / ppuPageSize) & 0x03][address % ppuPageSize] = data;
+    }
+    else // Palette RAM
+    {
+        m_paletteRam[getPaletteIndex(address)] = data & 0x3F;
+    }
+}
+
+size_t Ricoh2C02::getPaletteIndex(uint16_t address)
+{
+    // 0x3F10, 0x3F14, 0x3F18 and 0x3F1C mirror the background entries
+    size_t index{address & 0x1Fu};
+    if ((index & 0x13) == 0x10)
+    {
+        index &= ~0x10u;
+    }
+    return index;
+}
+
+uint8_t Ricoh2C02::readRegister(uint16_t address, Badge<CpuMemory>)
+{
+    // Status polling only matters to the renderer when it resets the write toggle
+    const uint8_t reg{static_cast<uint8_t>(address & 0x7)};
+    if (reg == 0x7 || (reg == 0x2 && m_w))
+    {
+        record(PpuEvent{m_cycleCount, PpuEvent::Kind::ReadRegister, 0, address, 0, 0, nullptr, nullptr});
+    }
+    return readRegister(address);
+}
+
+void Ricoh2C02::writeRegister(uint16_t address, uint8_t data, Badge<CpuMemory>)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::WriteRegister, data, address, 0, 0, nullptr, nullptr});
+    writeRegister(address, data);
+}
+
+uint8_t Ricoh2C02::readRegister(uint16_t address)
+{
+    switch (address & 0x7)
+    {
+    case 0x2: // PPUSTATUS
+        m_latch = (m_status & 0xE0) | (m_latch & 0x1F);
+        m_status &= ~StatusBits::VBlank;
+        m_w = false;
+        break;
+    case 0x4: // OAMDATA
+        m_latch = m_objectAttributeMemory[m_oamAddress];
+        break;
+    case 0x7: // PPUDATA
+        if ((m_v & 0x3FFF) <= 0x3EFF)
+        {
+            m_latch = m_readBuffer;
+            m_readBuffer = read(m_v);
+        }
+        else
+        {
+            // Palette reads are not buffered, the buffer is filled with the nametable byte below
+            m_latch = (m_latch & 0xC0) | read(m_v);
+            m_readBuffer = read(m_v - 0x1000);
+        }
+        m_v += m_control & ControlBits::Increment ? 32 : 1;
+        break;
+    default: // Write-only registers
+        break;
+    }
+
+    return m_latch;
+}
+
+void Ricoh2C02::writeRegister(uint16_t address, uint8_t data)
+{
+    m_latch = data;
+
+    switch (address & 0x7)
+    {
+    case 0x0: // PPUCTRL
+        // Enabling NMI during vblank raises one immediately
+        m_nmiRequested |= 
+            !(m_control & ControlBits::NmiEnable) && (data & ControlBits::NmiEnable) && (m_status & StatusBits::VBlank);
+        m_control = data;
+        m_t = (m_t & 0xF3FF) | ((data & ControlBits::Nametable) << 10);
+        break;
+    case 0x1: // PPUMASK
+        m_mask = data;
+        break;
+    case 0x3: // OAMADDR
+        m_oamAddress = data;
+        break;
+    case 0x4: // OAMDATA
+        m_objectAttributeMemory[m_oamAddress++] = data;
+        break;
+    case 0x5: // PPUSCROLL
+        if (!m_w)
+        {
+            m_t = (m_t & 0xFFE0) | (data >> 3);
+            m_x = data & 0x07;
+        }
+        else
+        {
+            m_t = (m_t & 0x8C1F) | ((data & 0x07) << 12) | ((data & 0xF8) << 2);
+        }
+        m_w = !m_w;
+        break;
+    case 0x6: // PPUADDR
+        if (!m_w)
+        {
+            m_t = (m_t & 0x00FF) | ((data & 0x3F) << 8);
+        }
+        else
+        {
+            m_t = (m_t & 0xFF00) | data;
+            m_v = m_t;
+        }
+        m_w = !m_w;
+        break;
+    case 0x7: // PPUDATA
+        write(m_v, data);
+        m_v += m_control & ControlBits::Increment ? 32 : 1;
+        break;
+    default: // PPUSTATUS is read-only
+        break;
+    }
+}
+
+uint32_t Ricoh2C02::getCyclesUntil(int16_t scanline, uint16_t cycle) const
+{
+    const int32_t cyclesPerFrame{cyclesPerScanline * m_scanlineCount};
+    const int32_t now{(m_scanline - preRenderScanline) * cyclesPerScanline + m_cycle};
+    const int32_t then{(scanline - preRenderScanline) * cyclesPerScanline + cycle};
+    const int32_t cycles{(then - now + cyclesPerFrame) % cyclesPerFrame};
+    return cycles == 0 ? cyclesPerFrame : cycles;
+}
+
+std::span<const uint8_t> Ricoh2C02::getFrameBuffer() const
+{
+    return m_frameBuffer;
+}
+
+std::span<const uint8_t, Screen::height> Ricoh2C02::getEmphasis() const
+{
+    return m_emphasis;
+}
+
+void Ricoh2C02::setSpriteLimit(bool enabled)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::SpriteLimit, enabled, 0, 0, 0, nullptr, nullptr});
+    m_spriteLimit = enabled;
+}
+
+bool Ricoh2C02::getSpriteLimit() const
+{
+    return m_spriteLimit;
+}
+
+void Ricoh2C02::setOutputEnabled(bool enabled)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::Output, enabled, 0, 0, 0, nullptr, nullptr});
+    m_outputEnabled = enabled;
+}
+
+void Ricoh2C02::setRegion(Region region)
+{
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::Region, static_cast<uint8_t>(region), 0, 0, 0, nullptr, nullptr});
+    m_region = region;
+    m_scanlineCount = getRegionTiming(region).m_scanlineCount;
+    m_vblankScanline = getRegionTiming(region).m_vblankScanline;
+}
+
+int16_t Ricoh2C02::getScanlineCount() const
+{
+    return m_scanlineCount;
+}
+
+int16_t Ricoh2C02::getVblankScanline() const
+{
+    return m_vblankScanline;
+}
+
+void Ricoh2C02::saveState(StateWriter& writer) const
+{
+    writer.write(m_scanline);
+    writer.write(m_cycle);
+    writer.write(m_cycleCount);
+    writer.write(m_frameCount);
 
+    writer.write(m_control);
+    writer.write(m_mask);
+    writer.write(m_status);
+    writer.write(m_oamAddress);
+    writer.write(m_latch);
+    writer.write(m_readBuffer);
+    writer.write(m_nmiRequested);
+    writer.write(m_v);
+    writer.write(m_t);
+    writer.write(m_x);
+    writer.write(m_w);
+
+    writer.write(m_objectAttributeMemory.data(), m_objectAttributeMemory.size());
+    writer.write(m_vram);
+    writer.write(m_paletteRam);
+    writer.write(static_cast<uint32_t>(m_chrRam.size()));
+    writer.write(m_chrRam.data(), m_chrRam.size());
+}
+
+void Ricoh2C02::parseState(StateReader& reader, State& state) const
+{
+    reader.read(state.m_scanline);
+    reader.read(state.m_cycle);
+    reader.read(state.m_cycleCount);
+    reader.read(state.m_frameCount);
+
+    reader.read(state.m_control);
+    reader.read(state.m_mask);
+    reader.read(state.m_status);
+    reader.read(state.m_oamAddress);
+    reader.read(state.m_latch);
+    reader.read(state.m_readBuffer);
+    reader.read(state.m_nmiRequested);
+    reader.read(state.m_v);
+    reader.read(state.m_t);
+    reader.read(state.m_x);
+    reader.read(state.m_w);
+
+    state.m_objectAttributeMemory = reader.readSpan(m_objectAttributeMemory.size());
+    state.m_vram = reader.readSpan(m_vram.size());
+    state.m_paletteRam = reader.readSpan(m_paletteRam.size());
+
+    // CHR-RAM is allocated by the mapper, a state of another cartridge doesn't fit
+    uint32_t chrRamSize{0};
+    reader.read(chrRamSize);
+    if (chrRamSize != m_chrRam.size())
+    {
+        reader.invalidate();
+    }
+    state.m_chrRam = reader.readSpan(m_chrRam.size());
+
+    // The position has to be on the frame of the region, the header of the state ensures the region
+    if (state.m_scanline < preRenderScanline || state.m_scanline >= preRenderScanline + m_scanlineCount ||
+        state.m_cycle >= cyclesPerScanline)
+    {
+        reader.invalidate();
+    }
+}
+
+void Ricoh2C02::loadState(const State& state)
+{
+    m_scanline = state.m_scanline;
+    m_cycle = state.m_cycle;
+    m_cycleCount = state.m_cycleCount;
+    m_frameCount = state.m_frameCount;
+
+    m_control = state.m_control;
+    m_mask = state.m_mask;
+    m_status = state.m_status;
+    m_oamAddress = state.m_oamAddress;
+    m_latch = state.m_latch;
+    m_readBuffer = state.m_readBuffer;
+    m_nmiRequested = state.m_nmiRequested;
+    m_v = state.m_v;
+    m_t = state.m_t;
+    m_x = state.m_x;
+    m_w = state.m_w;
+
+    std::copy(state.m_objectAttributeMemory.begin(), state.m_objectAttributeMemory.end(), m_objectAttributeMemory.begin());
+    std::copy(state.m_vram.begin(), state.m_vram.end(), m_vram.begin());
+    std::copy(state.m_paletteRam.begin(), state.m_paletteRam.end(), m_paletteRam.begin());
+
+    // Only tiles that changed are decoded again, in place, so the pattern pages keep pointing
+    // into the cache. Loading a recent state usually leaves all of them as they are.
+    for (size_t offset{0}; offset < m_chrRam.size(); offset += PatternCache::bytesPerTile)
+    {
+        const uint8_t* tile{state.m_chrRam.data() + offset};
+        if (std::memcmp(tile, m_chrRam.data() + offset, PatternCache::bytesPerTile) != 0)
+        {
+            std::memcpy(m_chrRam.data() + offset, tile, PatternCache::bytesPerTile);
+            for (size_t row{0}; row < PatternCache::rowsPerTile; ++row)
+            {
+                m_chrRamPatterns.update(m_chrRam, offset + row);
+            }
+        }
+    }
+
+    if (m_renderer)
+    {
+        m_renderer->loadState(state);
+    }
+}
+
+void Ricoh2C02::setRenderer(PpuRenderer* renderer, Badge<Nes>)
+{
+    assert(!m_mapper);
+    m_renderer = renderer;
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::SpriteLimit, m_spriteLimit, 0, 0, 0, nullptr, nullptr});
+    record(PpuEvent{m_cycleCount, PpuEvent::Kind::Region, static_cast<uint8_t>(m_region), 0, 0, 0, nullptr, nullptr});
+}
+
+void Ricoh2C02::record(const PpuEvent& event)
+{
+    if (m_renderer)
+    {
+        m_renderer->push(event);
+    }
+}
+
+void Ricoh2C02::replay(const PpuEvent& event, Badge<PpuRenderer>)
+{
+    catchUp(event.m_time);
+
+    switch (event.m_kind)
+    {
+    case PpuEvent::Kind::ReadRegister:
+        readRegister(event.m_address);
+        break;
+    case PpuEvent::Kind::WriteRegister:
+        writeRegister(event.m_address, event.m_data);
+        break;
+    case PpuEvent::Kind::AllocateChrRam:
+        allocateChrRam(event.m_size);
+        break;
+    case PpuEvent::Kind::MapChrRom:
+        mapChrRom(event.m_address, event.m_size, event.m_chr, event.m_rows);
+        break;
+    case PpuEvent::Kind::MapChrRam:
+        mapChrRam(event.m_address, event.m_size, event.m_offset);
+        break;
+    case PpuEvent::Kind::MapNametable:
+        mapNametable(event.m_size, event.m_offset);
+        break;
+    case PpuEvent::Kind::SpriteLimit:
+        m_spriteLimit = event.m_data;
+        break;
+    case PpuEvent::Kind::Region:
+        setRegion(static_cast<Region>(event.m_data));
+        break;
+    case PpuEvent::Kind::Output:
+        m_outputEnabled = event.m_data;
+        break;
+    default: // Frame end only needs the catch up
+        break;
+    }
+}
+
+bool Ricoh2C02::pollNmi()
+{
+    const bool nmiRequested{m_nmiRequested};
+    m_nmiRequested = false;
+    return nmiRequested;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <iterator>
+
+#include "libnes/scheduler.h"
+
+namespace LibNes
+{
+
+Scheduler::Scheduler() :
+	m_queue{},
+	m_time{0}
+{
+
+}
+
+void Scheduler::schedule(Event event, uint64_t time)
+{
+	cancel(event);
+
+	const auto position{std::upper_bound(m_queue.begin(), m_queue.end(), time, 
+		[](uint64_t time, const ScheduledEvent& scheduled) { return time > scheduled.m_time; })};
+	m_queue.insert(position, {event, time});
+}
+
+void Scheduler::cancel(Event event)
+{
+	m_queue.erase(
+		std::remove_if(m_queue.begin(), m_queue.end(), 
+			[event](const ScheduledEvent& scheduled) { return scheduled.m_event == event; }),
+		m_queue.end());
+}
+
+uint64_t Scheduler::getTime() const
+{
+	return m_time;
+}
+
+void Scheduler::advanceTo(uint64_t time)
+{
+	m_time = std::max(m_time, time);
+}
+
+uint64_t Scheduler::getNextEventTime() const
+{
+	return m_queue.empty() ? never : m_queue.back().m_time;
+}
+
+std::optional<Scheduler::ScheduledEvent> Scheduler::popDueEvent()
+{
+	if (m_queue.empty() || m_queue.back().m_time > m_time)
+	{
+		return std::nullopt;
+	}
+
+	const ScheduledEvent event{m_queue.back()};
+	m_queue.pop_back();
+	return event;
+}
+
+void Scheduler::saveState(StateWriter& writer) const
+{
+	writer.write(m_time);
+	writer.write(static_cast<uint32_t>(m_queue.size()));
+	// Field by field, the padding of ScheduledEvent would make equal states differ
+	for (const ScheduledEvent& event : m_queue)
+	{
+		writer.write(event.m_event);
+		writer.write(event.m_time);
+	}
+}
+
+void Scheduler::loadState(StateReader& reader)
+{
+	uint32_t size{0};
+	reader.read(m_time);
+	reader.read(size);
+
+	// Every event is pending at most once
+	constexpr uint32_t eventCount{static_cast<uint32_t>(Event::FrameEnd) + 1};
+	if (size > eventCount)
+	{
+		reader.invalidate();
+		return;
+	}
+
+	m_queue.resize(size);
+	for (ScheduledEvent& event : m_queue)
+	{
+		reader.read(event.m_event);
+		reader.read(event.m_time);
+	}
+
+	// Only known events, each once and latest first, as schedule keeps them
+	for (auto event{m_queue.begin()}; event != m_queue.end(); ++event)
+	{
+		const auto sameEvent{[event](const ScheduledEvent& other) { return other.m_event == event->m_event; }};
+		if (static_cast<uint32_t>(event->m_event) >= eventCount ||
+			std::find_if(m_queue.begin(), event, sameEvent) != event ||
+			(event != m_queue.begin() && std::prev(event)->m_time < event->m_time))
+		{
+			reader.invalidate();
+		}
+	}
+}
+
+} // namespace LibNes
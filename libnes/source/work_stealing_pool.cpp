@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <thread>
+
+#include "libnes/work_stealing_pool.h"
+
+namespace LibNes
+{
+
+WorkStealingPool::WorkStealingPool(size_t threadCount) :
+	m_threadCount{std::max<size_t>(threadCount, 1)}
+{
+
+}
+
+size_t WorkStealingPool::getThreadCount() const
+{
+	return m_threadCount;
+}
+
+void WorkStealingPool::run(size_t taskCount, const Task& task)
+{
+	std::vector<Queue> queues(m_threadCount);
+	for (size_t index{0}; index < taskCount; ++index)
+	{
+		queues[index % m_threadCount].m_tasks.push_back(index);
+	}
+
+	// The calling thread works as well
+	std::vector<std::thread> threads;
+	for (size_t worker{1}; worker < m_threadCount; ++worker)
+	{
+		threads.emplace_back(&WorkStealingPool::work, this, std::ref(queues), worker, std::cref(task));
+	}
+	work(queues, 0, task);
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+std::optional<size_t> WorkStealingPool::pop(Queue& queue)
+{
+	const std::lock_guard lock{queue.m_mutex};
+	if (queue.m_tasks.empty())
+	{
+		return std::nullopt;
+	}
+
+	const size_t task{queue.m_tasks.back()};
+	queue.m_tasks.pop_back();
+	return task;
+}
+
+std::optional<size_t> WorkStealingPool::steal(Queue& queue)
+{
+	const std::lock_guard lock{queue.m_mutex};
+	if (queue.m_tasks.empty())
+	{
+		return std::nullopt;
+	}
+
+	const size_t task{queue.m_tasks.front()};
+	queue.m_tasks.pop_front();
+	return task;
+}
+
+void WorkStealingPool::work(std::vector<Queue>& queues, size_t worker, const Task& task)
+{
+	while (true)
+	{
+		std::optional<size_t> next{pop(queues[worker])};
+		for (size_t offset{1}; !next && offset < queues.size(); ++offset)
+		{
+			next = steal(queues[(worker + offset) % queues.size()]);
+		}
+
+		// No task adds new ones, so once every queue is empty the work is done
+		if (!next)
+		{
+			return;
+		}
+
+		task(*next, worker);
+	}
+}
+
+} // namespace LibNes
@@ -0,0 +1,191 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(LIBNES_LOG)
+#include <fstream>
+#endif
+
+#include "libnes/nes.h"
+#include "libnes/null_screen.h"
+#include "libnes/rewind_buffer.h"
+#include "test_rom.h"
+
+using namespace LibNes;
+using namespace LibNes::Test;
+
+namespace
+{
+
+#if defined(LIBNES_LOG)
+std::ofstream log;
+#endif
+
+void runFrame(Nes& nes)
+{
+	nes.runFrame(
+#if defined(LIBNES_LOG)
+		log
+#endif
+	);
+}
+
+std::unique_ptr<Nes> createConsole(TestProgram program, bool spriteLimit = true, bool threaded = false)
+{
+	auto nes{std::make_unique<Nes>(std::make_shared<NullScreen>())};
+	nes->setSpriteLimit(spriteLimit);
+	nes->setThreadedRendering(threaded);
+	std::istringstream rom{buildTestRom(program)};
+	if (!nes->loadCartridge(rom))
+	{
+		std::cerr << "Test ROM does not load\n";
+		std::exit(EXIT_FAILURE);
+	}
+	nes->reset();
+	return nes;
+}
+
+void print(const std::string& name, const std::string& unit, uint64_t count, std::chrono::duration<double> elapsed)
+{
+	std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1) <<
+		std::setw(12) << count / elapsed.count() << " " << unit << "/s" <<
+		std::setw(12) << elapsed.count() / count * 1e6 << " us\n";
+}
+
+// Prints the rate of calls to operation over about a second, after a warm up
+template<typename Operation>
+void measure(const std::string& name, const std::string& unit, Operation operation)
+{
+	for (int warmUp{0}; warmUp < 10; ++warmUp)
+	{
+		operation();
+	}
+
+	uint64_t count{0};
+	const auto start{std::chrono::steady_clock::now()};
+	std::chrono::duration<double> elapsed{0};
+	do
+	{
+		for (int call{0}; call < 10; ++call)
+		{
+			operation();
+		}
+		count += 10;
+		elapsed = std::chrono::steady_clock::now() - start;
+	} while (elapsed.count() < 1.0);
+
+	print(name, unit, count, elapsed);
+}
+
+void benchFrames()
+{
+	const struct
+	{
+		std::string m_name;
+		TestProgram m_program;
+		bool m_spriteLimit;
+		bool m_threaded;
+	} scenes[]{
+		{"background", TestProgram::Scrolling, true, false},
+		{"64 sprites", TestProgram::Sprites, true, false},
+		{"64 sprites without sprite limit", TestProgram::Sprites, false, false},
+		{"64 sprites, threaded", TestProgram::Sprites, true, true},
+		{"sprite 0 hit", TestProgram::Sprite0Hit, true, false},
+		{"CHR-RAM", TestProgram::ChrRam, true, false}};
+
+	for (const auto& scene : scenes)
+	{
+		auto nes{createConsole(scene.m_program, scene.m_spriteLimit, scene.m_threaded)};
+		measure(scene.m_name, "frames", [&nes] { runFrame(*nes); });
+	}
+}
+
+void benchStates()
+{
+	for (const TestProgram program : {TestProgram::Sprite0Hit, TestProgram::ChrRam})
+	{
+		const std::string name{program == TestProgram::ChrRam ? "CHR-RAM" : "CHR-ROM"};
+		auto nes{createConsole(program)};
+		for (int frame{0}; frame < 10; ++frame)
+		{
+			runFrame(*nes);
+		}
+
+		std::vector<uint8_t> state;
+		measure("save state, " + name, "states", [&nes, &state] { nes->saveState(state); });
+		measure("load state, " + name, "states", [&nes, &state]
+		{
+			if (!nes->loadState(state))
+			{
+				std::cerr << "Saved state does not load\n";
+				std::exit(EXIT_FAILURE);
+			}
+		});
+	}
+}
+
+// Capturing before each of 10 seconds of frames, then rewinding all of them
+void benchRewind()
+{
+	constexpr int frames{600};
+	for (const TestProgram program : {TestProgram::Sprite0Hit, TestProgram::ChrRam})
+	{
+		const std::string name{program == TestProgram::ChrRam ? "CHR-RAM" : "CHR-ROM"};
+		auto nes{createConsole(program)};
+		RewindBuffer buffer{0x1000000};
+		for (int frame{0}; frame < frames; ++frame)
+		{
+			buffer.capture(*nes);
+			runFrame(*nes);
+		}
+		const RewindBuffer::Statistics statistics{buffer.getStatistics()};
+		print("rewind capture, " + name, "states", statistics.m_capturedFrames, statistics.m_captureTime);
+
+		const auto start{std::chrono::steady_clock::now()};
+		while (buffer.rewind(*nes))
+		{
+		}
+		print("rewind, " + name, "states", frames, std::chrono::steady_clock::now() - start);
+		std::cout << std::left << std::setw(36) << "rewind compression ratio, " + name << std::right << std::setw(12) << statistics.getCompressionRatio() << "\n";
+	}
+}
+
+// Creating and destroying clones, and a frame on a fresh clone each time
+void benchClones()
+{
+	for (const TestProgram program : {TestProgram::Sprite0Hit, TestProgram::ChrRam})
+	{
+		const std::string name{program == TestProgram::ChrRam ? "CHR-RAM" : "CHR-ROM"};
+		auto nes{createConsole(program)};
+		for (int frame{0}; frame < 10; ++frame)
+		{
+			runFrame(*nes);
+		}
+
+		const auto screen{std::make_shared<NullScreen>()};
+		measure("clone, " + name, "clones", [&nes, &screen] { nes->clone(screen); });
+		measure("clone and run a frame, " + name, "clones", [&nes, &screen]
+		{
+			auto clone{nes->clone(screen)};
+			runFrame(*clone);
+		});
+	}
+}
+
+}
+
+// Emulation speed of the whole console on the test programs, in frames per second of wall time,
+// the rate of saving, loading, capturing and rewinding states, and of cloning the console
+int main()
+{
+	benchFrames();
+	benchStates();
+	benchRewind();
+	benchClones();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,622 @@
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(LIBNES_LOG)
+#include <fstream>
+#endif
+
+#include "libnes/nes.h"
+#include "libnes/rewind_buffer.h"
+#include "test_rom.h"
+
+using namespace LibNes;
+using namespace LibNes::Test;
+
+namespace
+{
+
+int failures{0};
+
+void check(bool condition, const std::string& description)
+{
+	if (!condition)
+	{
+		++failures;
+		std::cout << "FAILED: " << description << "\n";
+	}
+}
+
+std::string hex(uint64_t value)
+{
+	std::ostringstream stream;
+	stream << std::hex << std::setfill('0') << std::setw(16) << value;
+	return stream.str();
+}
+
+#if defined(LIBNES_LOG)
+// Never opened, the log lines go nowhere
+std::ofstream log;
+#endif
+
+void runFrame(Nes& nes)
+{
+	nes.runFrame(
+#if defined(LIBNES_LOG)
+		log
+#endif
+	);
+}
+
+void runCycles(Nes& nes, uint64_t cycles)
+{
+	nes.runCycles(cycles
+#if defined(LIBNES_LOG)
+		, log
+#endif
+	);
+}
+
+struct Settings
+{
+	TestProgram m_program{TestProgram::Sprite0Hit};
+	bool m_verticalMirroring{true};
+	Region m_region{Region::Ntsc};
+	bool m_spriteLimit{true};
+	bool m_threaded{false};
+};
+
+// A console with the test program loaded and reset
+struct Console
+{
+	explicit Console(const Settings& settings = {}) :
+		m_screen{std::make_shared<HashScreen>()},
+		m_nes{std::make_unique<Nes>(m_screen)}
+	{
+		m_nes->setRegion(settings.m_region);
+		m_nes->setSpriteLimit(settings.m_spriteLimit);
+		m_nes->setThreadedRendering(settings.m_threaded);
+		std::istringstream rom{buildTestRom(settings.m_program, settings.m_verticalMirroring)};
+		const bool loaded{m_nes->loadCartridge(rom)};
+		check(loaded, "Test ROM loads");
+		m_nes->reset();
+	}
+
+	// Destroying the console waits for the rendering thread, so the screen has every frame
+	void finish()
+	{
+		m_nes.reset();
+	}
+
+	std::shared_ptr<HashScreen> m_screen;
+	std::unique_ptr<Nes> m_nes;
+};
+
+constexpr int regressionFrames{120};
+
+// Frame hashes of the test programs, recorded when the PPU still stepped one dot at a time.
+// The threaded and bulk scanline renderers have to produce the same pictures.
+void checkFrameHashes()
+{
+	struct Case
+	{
+		std::string m_name;
+		Settings m_settings;
+		uint64_t m_expectedHash;
+	};
+
+	const Case cases[]{
+		{"scrolling, horizontal mirroring", {TestProgram::Scrolling, false}, 0x6d35b7cfce376d7f},
+		{"scrolling, vertical mirroring", {TestProgram::Scrolling, true}, 0x06e79de35433ac75},
+		{"sprites", {TestProgram::Sprites}, 0x50c62e02a5379f0d},
+		{"sprites without sprite limit", {TestProgram::Sprites, true, Region::Ntsc, false}, 0xf8fe4478a8656f33},
+		{"sprite 0 hit", {TestProgram::Sprite0Hit}, 0x96de3c95f609a135},
+		{"sprite 0 hit, threaded", {TestProgram::Sprite0Hit, true, Region::Ntsc, true, true}, 0x96de3c95f609a135},
+		{"sprite 0 hit, PAL", {TestProgram::Sprite0Hit, true, Region::Pal}, 0x3850df49fe6af28d},
+		{"sprite 0 hit, Dendy", {TestProgram::Sprite0Hit, true, Region::Dendy}, 0x75185cb9705999ff},
+		{"CHR-RAM", {TestProgram::ChrRam, false}, 0x925fd4071ce5fa87},
+		{"CHR-RAM, threaded", {TestProgram::ChrRam, false, Region::Ntsc, true, true}, 0x925fd4071ce5fa87}};
+
+	for (const Case& testCase : cases)
+	{
+		Console console{testCase.m_settings};
+		for (int frame{0}; frame < regressionFrames; ++frame)
+		{
+			runFrame(*console.m_nes);
+		}
+		console.finish();
+		check(console.m_screen->m_frameCount == regressionFrames, testCase.m_name + ": " + std::to_string(console.m_screen->m_frameCount) + " frames presented");
+		check(console.m_screen->m_hash == testCase.m_expectedHash, testCase.m_name + ": frame hash " + hex(console.m_screen->m_hash) + " instead of " + hex(testCase.m_expectedHash));
+	}
+}
+
+// Running in slices of any size ends in the same state as running by frames
+void checkSlicing()
+{
+	for (const TestProgram program : {TestProgram::Sprite0Hit, TestProgram::ChrRam})
+	{
+		Console byFrames{{program}};
+		Console bySlices{{program}};
+		for (int frame{0}; frame < 30; ++frame)
+		{
+			runFrame(*byFrames.m_nes);
+		}
+
+		uint32_t random{1};
+		while (bySlices.m_nes->getMasterCycleCount() < byFrames.m_nes->getMasterCycleCount())
+		{
+			random = random * 1103515245 + 12345;
+			const uint64_t remaining{(byFrames.m_nes->getMasterCycleCount() - bySlices.m_nes->getMasterCycleCount()) / 12};
+			runCycles(*bySlices.m_nes, std::max<uint64_t>(1, std::min<uint64_t>(remaining, 1 + (random >> 16) % 5000)));
+		}
+
+		// Then the same frame on both, so the time the last run asked for is the same as well
+		runFrame(*byFrames.m_nes);
+		runFrame(*bySlices.m_nes);
+		std::vector<uint8_t> frameState;
+		std::vector<uint8_t> sliceState;
+		byFrames.m_nes->saveState(frameState);
+		bySlices.m_nes->saveState(sliceState);
+		check(byFrames.m_screen->m_hash == bySlices.m_screen->m_hash, "Slicing the run gives the same frames");
+		check(frameState == sliceState, "Slicing the run ends in the same state");
+	}
+}
+
+// Images without PRG-ROM or cut short are rejected and leave the current cartridge in.
+// Bank counts of 128 and more are read unsigned.
+void checkCartridgeLoading()
+{
+	const std::vector<uint8_t> chrRom(0x2000);
+	Console console;
+	Console reference;
+	for (int frame{0}; frame < 10; ++frame)
+	{
+		runFrame(*console.m_nes);
+		runFrame(*reference.m_nes);
+	}
+
+	std::istringstream noPrgRom{buildINes(0, 1, 0, chrRom)};
+	check(!console.m_nes->loadCartridge(noPrgRom), "An image without PRG-ROM is rejected");
+
+	std::vector<uint8_t> banks(200 * 0x4000 + 0x2000);
+	std::istringstream truncated{buildINes(200, 1, 0, std::span{banks}.first(100 * 0x4000))};
+	check(!console.m_nes->loadCartridge(truncated), "An image shorter than its 200 PRG banks is rejected");
+
+	for (int frame{0}; frame < 10; ++frame)
+	{
+		runFrame(*console.m_nes);
+		runFrame(*reference.m_nes);
+	}
+	std::vector<uint8_t> state;
+	std::vector<uint8_t> referenceState;
+	console.m_nes->saveState(state);
+	reference.m_nes->saveState(referenceState);
+	check(state == referenceState, "A rejected image leaves the cartridge in");
+
+	std::istringstream manyBanks{buildINes(200, 1, 0, banks)};
+	check(console.m_nes->loadCartridge(manyBanks), "An image with 200 PRG banks loads");
+}
+
+// A saved state loaded into another console continues exactly as the original did
+void checkStateRoundTrip()
+{
+	for (const Settings& settings : {Settings{TestProgram::Sprite0Hit}, Settings{TestProgram::ChrRam}, Settings{TestProgram::ChrRam, true, Region::Ntsc, true, true}})
+	{
+		Console original{settings};
+		Console copy{settings};
+		for (int frame{0}; frame < 20; ++frame)
+		{
+			runFrame(*original.m_nes);
+		}
+		for (int frame{0}; frame < 5; ++frame)
+		{
+			runFrame(*copy.m_nes);
+		}
+
+		std::vector<uint8_t> state;
+		original.m_nes->saveState(state);
+		check(copy.m_nes->loadState(state), "A state of the same cartridge loads");
+		check(copy.m_nes->getFrameCount() == 20 && copy.m_nes->getMasterCycleCount() == original.m_nes->getMasterCycleCount(), "Loading restores the time");
+
+		for (int frame{0}; frame < 20; ++frame)
+		{
+			runFrame(*original.m_nes);
+			runFrame(*copy.m_nes);
+		}
+		std::vector<uint8_t> originalState;
+		std::vector<uint8_t> copyState;
+		original.m_nes->saveState(originalState);
+		copy.m_nes->saveState(copyState);
+		check(originalState == copyState, "A loaded state runs on the same");
+
+		original.finish();
+		copy.finish();
+		check(original.m_screen->m_lastFrameHash == copy.m_screen->m_lastFrameHash, "A loaded state renders the same");
+	}
+}
+
+// A state that doesn't fit is rejected and leaves the machine as it was
+void checkInvalidStates()
+{
+	Console console;
+	Console reference;
+	Console otherCartridge{{TestProgram::ChrRam}};
+	for (int frame{0}; frame < 10; ++frame)
+	{
+		runFrame(*console.m_nes);
+		runFrame(*reference.m_nes);
+		runFrame(*otherCartridge.m_nes);
+	}
+
+	std::vector<uint8_t> before;
+	console.m_nes->saveState(before);
+	std::vector<uint8_t> after;
+	const auto checkRejected{[&](std::span<const uint8_t> state, const std::string& description)
+	{
+		check(!console.m_nes->loadState(state), description + " is rejected");
+		console.m_nes->saveState(after);
+		check(after == before, description + " leaves the machine as it was");
+	}};
+
+	std::vector<uint8_t> state{before};
+	checkRejected(std::span{state}.first(state.size() - 1), "A truncated state");
+	state.push_back(0);
+	checkRejected(state, "A state with a byte too many");
+	std::vector<uint8_t> otherState;
+	otherCartridge.m_nes->saveState(otherState);
+	checkRejected(otherState, "A state of another cartridge");
+
+	// Every byte set to 0xFF in turn: magic, sizes, bools, the PPU position, the scheduler queue
+	// and the mirroring don't take it. Whatever loads has to load completely.
+	size_t rejected{0};
+	for (size_t offset{0}; offset < before.size(); ++offset)
+	{
+		state = before;
+		state[offset] = ~state[offset];
+		if (!console.m_nes->loadState(state))
+		{
+			++rejected;
+			console.m_nes->saveState(after);
+			check(after == before, "A state corrupted at " + std::to_string(offset) + " leaves the machine as it was");
+		}
+		else
+		{
+			console.m_nes->saveState(after);
+			check(after == state, "A state corrupted at " + std::to_string(offset) + " loads completely");
+			check(console.m_nes->loadState(before), "The original state loads again");
+		}
+	}
+	check(rejected > 0, "Corrupted states are rejected");
+
+	for (int frame{0}; frame < 10; ++frame)
+	{
+		runFrame(*console.m_nes);
+		runFrame(*reference.m_nes);
+	}
+	console.m_nes->saveState(after);
+	std::vector<uint8_t> referenceState;
+	reference.m_nes->saveState(referenceState);
+	check(after == referenceState, "Rejected states don't change how the machine runs on");
+}
+
+// Running ahead presents the frame the given number of frames later, without changing the
+// emulation itself. Running on without runFrame or without run-ahead presents again.
+void checkRunAhead()
+{
+	constexpr int frames{10};
+	constexpr uint32_t runAhead{2};
+	for (const Nes::RunAhead mode : {Nes::RunAhead::Restore, Nes::RunAhead::SecondInstance})
+	{
+		for (const bool threaded : {false, true})
+		{
+			const std::string name{std::string{mode == Nes::RunAhead::Restore ? "Restore" : "SecondInstance"} + (threaded ? ", threaded" : "")};
+			const Settings settings{TestProgram::Sprite0Hit, true, Region::Ntsc, true, threaded};
+
+			Console future{settings};
+			for (int frame{0}; frame < frames + static_cast<int>(runAhead); ++frame)
+			{
+				runFrame(*future.m_nes);
+			}
+			future.finish();
+
+			Console plain{settings};
+			Console ahead{settings};
+			ahead.m_nes->setRunAhead(runAhead, mode);
+			for (int frame{0}; frame < frames; ++frame)
+			{
+				runFrame(*plain.m_nes);
+				runFrame(*ahead.m_nes);
+			}
+			std::vector<uint8_t> plainState;
+			std::vector<uint8_t> aheadState;
+			plain.m_nes->saveState(plainState);
+			ahead.m_nes->saveState(aheadState);
+			check(aheadState == plainState, name + ": running ahead leaves the emulated frame as it was");
+
+			Console presented{settings};
+			presented.m_nes->setRunAhead(runAhead, mode);
+			for (int frame{0}; frame < frames; ++frame)
+			{
+				runFrame(*presented.m_nes);
+			}
+			presented.finish();
+			check(presented.m_screen->m_frameCount == frames, name + ": " + std::to_string(presented.m_screen->m_frameCount) + " frames presented");
+			check(presented.m_screen->m_lastFrameHash == future.m_screen->m_lastFrameHash, name + ": the last frame presented is the one run ahead");
+
+			// Past a whole frame of cycles, then a frame without run-ahead
+			runCycles(*plain.m_nes, 40000);
+			runCycles(*ahead.m_nes, 40000);
+			ahead.m_nes->setRunAhead(0);
+			runFrame(*plain.m_nes);
+			runFrame(*ahead.m_nes);
+			plain.m_nes->saveState(plainState);
+			ahead.m_nes->saveState(aheadState);
+			check(aheadState == plainState, name + ": the console runs on as without run-ahead");
+
+			plain.finish();
+			ahead.finish();
+			check(ahead.m_screen->m_frameCount == plain.m_screen->m_frameCount, name + ": frames presented after running ahead");
+			check(ahead.m_screen->m_lastFrameHash == plain.m_screen->m_lastFrameHash, name + ": the frame presented after running ahead");
+		}
+	}
+}
+
+// Compressing and decompressing gives the data back, for zero runs and literals of any length
+void checkRewindCompression()
+{
+	TestRandom random{7};
+	std::vector<uint8_t> data;
+	for (const size_t length : {0, 1, 2, 3, 127, 128, 129, 300})
+	{
+		data.insert(data.end(), length, 0);
+		for (size_t byte{0}; byte < length; ++byte)
+		{
+			data.push_back(random.next() | 1);
+		}
+		data.insert(data.end(), length % 4, 0);
+	}
+
+	std::vector<uint8_t> compressed;
+	for (size_t size{0}; size <= data.size(); size += 37)
+	{
+		const std::span<const uint8_t> original{std::span{data}.first(size)};
+		RewindBuffer::compress(original, compressed);
+		std::vector<uint8_t> output(size);
+		RewindBuffer::decompress(compressed, output);
+		check(std::equal(output.begin(), output.end(), original.begin()), "Compressing " + std::to_string(size) + " bytes keeps them");
+	}
+}
+
+// Capturing before every frame and rewinding at random gives back each state byte for byte,
+// newest first. Small rings wrap around and drop the oldest keyframes with their deltas.
+void checkRewind()
+{
+	const struct
+	{
+		std::string m_name;
+		TestProgram m_program;
+		size_t m_capacity;
+		uint32_t m_keyframeInterval;
+	} cases[]{
+		{"large ring", TestProgram::Sprite0Hit, 0x100000, 4},
+		{"small ring", TestProgram::Sprite0Hit, 0x2000, 4},
+		{"small ring, keyframes only", TestProgram::Sprite0Hit, 0x2000, 1},
+		{"small ring, CHR-RAM", TestProgram::ChrRam, 0x6000, 4}};
+
+	for (const auto& testCase : cases)
+	{
+		Console console{{testCase.m_program}};
+		RewindBuffer buffer{testCase.m_capacity, testCase.m_keyframeInterval};
+		check(!buffer.rewind(*console.m_nes), testCase.m_name + ": an empty buffer doesn't rewind");
+
+		// The states the buffer should hold, oldest first
+		std::deque<std::vector<uint8_t>> expected;
+		std::vector<uint8_t> state;
+		TestRandom random{11};
+		bool evicted{false};
+		for (int step{0}; step < 300; ++step)
+		{
+			if (random.next() % 4 == 0 && !expected.empty())
+			{
+				check(buffer.rewind(*console.m_nes), testCase.m_name + ": rewinds at step " + std::to_string(step));
+				console.m_nes->saveState(state);
+				check(state == expected.back(), testCase.m_name + ": rewound state at step " + std::to_string(step));
+				expected.pop_back();
+			}
+			else
+			{
+				console.m_nes->saveState(state);
+				expected.push_back(state);
+				check(buffer.capture(*console.m_nes), testCase.m_name + ": captures at step " + std::to_string(step));
+				runFrame(*console.m_nes);
+			}
+
+			check(buffer.getFrameCount() <= expected.size(), testCase.m_name + ": no more frames than captured");
+			while (expected.size() > buffer.getFrameCount())
+			{
+				expected.pop_front();
+				evicted = true;
+			}
+		}
+		check(evicted == (testCase.m_capacity < 0x100000), testCase.m_name + (evicted ? ": frames dropped" : ": no frames dropped"));
+
+		while (!expected.empty())
+		{
+			check(buffer.rewind(*console.m_nes), testCase.m_name + ": rewinds to the oldest frame");
+			console.m_nes->saveState(state);
+			check(state == expected.back(), testCase.m_name + ": rewound state, " + std::to_string(expected.size()) + " frames left");
+			expected.pop_back();
+		}
+		check(buffer.getFrameCount() == 0 && buffer.getStatistics().m_storedBytes == 0, testCase.m_name + ": rewound to empty");
+		check(!buffer.rewind(*console.m_nes), testCase.m_name + ": rewinding past the oldest frame fails");
+
+		// Starts over from a keyframe
+		console.m_nes->saveState(state);
+		check(buffer.capture(*console.m_nes), testCase.m_name + ": captures after emptying");
+		runFrame(*console.m_nes);
+		std::vector<uint8_t> rewound;
+		check(buffer.rewind(*console.m_nes), testCase.m_name + ": rewinds after emptying");
+		console.m_nes->saveState(rewound);
+		check(rewound == state, testCase.m_name + ": rewound state after emptying");
+	}
+}
+
+// A clone continues exactly as the original would, also when both run alternately from
+// different points in time, so neither shares any machine state with the other
+void checkClone()
+{
+	for (const Settings& settings : {Settings{TestProgram::Sprite0Hit}, Settings{TestProgram::ChrRam}, Settings{TestProgram::ChrRam, true, Region::Ntsc, true, true}})
+	{
+		const std::string name{std::string{settings.m_program == TestProgram::ChrRam ? "CHR-RAM" : "CHR-ROM"} + (settings.m_threaded ? ", threaded" : "")};
+
+		// States of a console that is never cloned: after the reset, before the program filled
+		// VRAM and CHR-RAM, and after 20 and 30 frames
+		Console reference{{settings.m_program}};
+		std::vector<uint8_t> earlyState;
+		std::vector<uint8_t> originalEndState;
+		std::vector<uint8_t> cloneEndState;
+		reference.m_nes->saveState(earlyState);
+		std::vector<uint64_t> frameHashes{0};
+		for (int frame{1}; frame <= 30; ++frame)
+		{
+			runFrame(*reference.m_nes);
+			frameHashes.push_back(reference.m_screen->m_lastFrameHash);
+			if (frame == 20)
+			{
+				reference.m_nes->saveState(originalEndState);
+			}
+		}
+		reference.m_nes->saveState(cloneEndState);
+
+		Console original{settings};
+		for (int frame{0}; frame < 10; ++frame)
+		{
+			runFrame(*original.m_nes);
+		}
+		auto screen{std::make_shared<HashScreen>()};
+		auto clone{original.m_nes->clone(screen)};
+
+		std::vector<uint8_t> originalState;
+		std::vector<uint8_t> cloneState;
+		original.m_nes->saveState(originalState);
+		clone->saveState(cloneState);
+		check(cloneState == originalState, name + ": the clone starts in the state of the original");
+
+		// The clone goes on from frame 10, the original starts over and fills its memory again
+		check(original.m_nes->loadState(earlyState), name + ": the original goes back");
+		bool framesMatch{true};
+		for (int frame{11}; frame <= 30; ++frame)
+		{
+			runFrame(*clone);
+			runFrame(*original.m_nes);
+			framesMatch &= screen->m_lastFrameHash == frameHashes[frame];
+		}
+		check(framesMatch, name + ": the clone renders every frame as the original would");
+		original.m_nes->saveState(originalState);
+		clone->saveState(cloneState);
+		check(cloneState == cloneEndState, name + ": the clone runs on as the original would");
+		check(originalState == originalEndState, name + ": the original runs on unaffected by the clone");
+
+		// A clone of the clone, destroyed before the clone
+		auto secondScreen{std::make_shared<HashScreen>()};
+		{
+			auto secondClone{clone->clone(secondScreen)};
+			runFrame(*secondClone);
+		}
+		runFrame(*clone);
+		runFrame(*reference.m_nes);
+		// Clones render unthreaded, their screens are up to date already
+		reference.finish();
+		check(screen->m_frameCount == 21, name + ": the clone presents on its own screen");
+		check(screen->m_lastFrameHash == reference.m_screen->m_lastFrameHash && secondScreen->m_lastFrameHash == reference.m_screen->m_lastFrameHash, name + ": clones render as the original would");
+
+		// In the middle of a frame, with the scroll registers and the position somewhere inside it
+		Console middle{{settings.m_program}};
+		for (int frame{0}; frame < 5; ++frame)
+		{
+			runFrame(*middle.m_nes);
+		}
+		runCycles(*middle.m_nes, 15000);
+		auto middleScreen{std::make_shared<HashScreen>()};
+		auto middleClone{middle.m_nes->clone(middleScreen)};
+		for (int frame{0}; frame < 3; ++frame)
+		{
+			runFrame(*middle.m_nes);
+			runFrame(*middleClone);
+		}
+		middle.m_nes->saveState(originalState);
+		middleClone->saveState(cloneState);
+		check(cloneState == originalState, name + ": a clone taken within a frame runs on as the original");
+		check(middleScreen->m_lastFrameHash == middle.m_screen->m_lastFrameHash, name + ": a clone taken within a frame renders as the original");
+
+		// Clones running on different threads at once, taken right after the reset so they fill
+		// the decode cache they share while running
+		Console source{settings};
+		std::vector<std::shared_ptr<HashScreen>> parallelScreens;
+		std::vector<decltype(source.m_nes->clone(screen))> parallelClones;
+		for (int i{0}; i < 3; ++i)
+		{
+			parallelScreens.push_back(std::make_shared<HashScreen>());
+			parallelClones.push_back(source.m_nes->clone(parallelScreens.back()));
+		}
+		std::vector<std::thread> threads;
+		for (auto& parallelClone : parallelClones)
+		{
+			threads.emplace_back([&nes = *parallelClone]
+			{
+#if defined(LIBNES_LOG)
+				std::ofstream threadLog; // the shared one must not be written from several threads
+#endif
+				for (int frame{0}; frame < 30; ++frame)
+				{
+					nes.runFrame(
+#if defined(LIBNES_LOG)
+						threadLog
+#endif
+					);
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		for (size_t i{0}; i < parallelClones.size(); ++i)
+		{
+			parallelClones[i]->saveState(cloneState);
+			check(cloneState == cloneEndState && parallelScreens[i]->m_lastFrameHash == frameHashes[30],
+				name + ": clone " + std::to_string(i) + " runs on its own thread as the original would");
+		}
+	}
+}
+
+}
+
+// Regression tests of the whole console on small generated programs.
+// Returns a failure exit code if anything differs.
+int main()
+{
+	checkFrameHashes();
+	checkSlicing();
+	checkCartridgeLoading();
+	checkStateRoundTrip();
+	checkInvalidStates();
+	checkRunAhead();
+	checkRewindCompression();
+	checkRewind();
+	checkClone();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "All checks passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#ifndef TEST_ROM_H
+#define TEST_ROM_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "libnes/screen.h"
+
+namespace LibNes::Test
+{
+
+// Small NROM programs exercising the PPU, built as iNES images in memory. All of them fill the
+// palette and a nametable, then scroll every frame from the NMI handler, so each frame differs.
+enum class TestProgram
+{
+	Scrolling, // Background only
+	Sprites, // 64 sprites, more than 8 on some scanlines, with OAM DMA every frame
+	Sprite0Hit, // Sprites, and a scroll change in the middle of the frame after every sprite 0 hit
+	ChrRam // Sprite0Hit on CHR-RAM filled by the program, which also changes a byte of it every frame
+};
+
+// Deterministic, so the expected frame hashes never change with the standard library
+class TestRandom
+{
+public:
+	explicit TestRandom(uint32_t seed) :
+		m_state{seed}
+	{
+	}
+
+	uint8_t next()
+	{
+		// xorshift32
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return static_cast<uint8_t>(m_state >> 24);
+	}
+
+private:
+	uint32_t m_state;
+};
+
+inline std::string buildINes(uint8_t prgBanks, uint8_t chrBanks, uint8_t flags6, std::span<const uint8_t> data)
+{
+	std::string image{"NES\x1A"};
+	image += static_cast<char>(prgBanks);
+	image += static_cast<char>(chrBanks);
+	image += static_cast<char>(flags6);
+	image.append(9, '\0');
+	image.append(data.begin(), data.end());
+	return image;
+}
+
+// A 16 KiB PRG bank mirrored at 0x8000 and 0xC000: the program at 0xC000, the NMI handler at 0xC100,
+// data for CHR-RAM at 0xD000 - 0xEFFF
+inline std::string buildTestRom(TestProgram program, bool verticalMirroring = true)
+{
+	std::vector<uint8_t> prg(0x4000, 0xEA);
+	TestRandom random{5};
+
+	std::vector<uint8_t> code{
+		0x78, 0xA2, 0xFF, 0x9A, // SEI, LDX #$FF, TXS
+		0x2C, 0x02, 0x20, 0x10, 0xFB, // Wait for vblank: BIT $2002, BPL
+		// Palette: 32 entries of X * 2
+		0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20,
+		0xA2, 0x00, 0x8A, 0x0A, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0x20, 0xD0, 0xF6,
+		// Nametable 0x2000 - 0x23FF: tiles 0 - 255, 4 times
+		0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20,
+		0xA0, 0x04, 0xA2, 0x00, 0x8A, 0x8D, 0x07, 0x20, 0xE8, 0xD0, 0xF9, 0x88, 0xD0, 0xF4};
+
+	if (program == TestProgram::ChrRam)
+	{
+		// Copies 0xD000 - 0xEFFF to CHR-RAM through the pointer in 0x02
+		code.insert(code.end(), {
+			0xA9, 0x00, 0x8D, 0x06, 0x20, 0x8D, 0x06, 0x20, // LDA #0, STA $2006, STA $2006
+			0x85, 0x02, 0xA9, 0xD0, 0x85, 0x03, // STA $02, LDA #$D0, STA $03
+			0xA2, 0x20, 0xA0, 0x00, // LDX #$20, LDY #0
+			0xB1, 0x02, 0x8D, 0x07, 0x20, 0xC8, 0xD0, 0xF8, // LDA ($02),Y, STA $2007, INY, BNE
+			0xE6, 0x03, 0xCA, 0xD0, 0xF3}); // INC $03, DEX, BNE
+	}
+
+	// Scroll 0, 0
+	code.insert(code.end(), {0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20});
+
+	if (program != TestProgram::Scrolling)
+	{
+		// OAM source page 0x0200: every byte its index, for varied tiles, attributes and X
+		code.insert(code.end(), {0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x02, 0xE8, 0xD0, 0xF9});
+		// Y 0x40 + sprite / 2, so 16 sprites share every scanline from 72 to 95
+		code.insert(code.end(), {
+			0xA2, 0x00, 0x8A, 0x4A, 0x4A, 0x4A, 0x09, 0x40, // LDX #0, TXA, LSR 3 times, ORA #$40
+			0x9D, 0x00, 0x02, 0xE8, 0xE8, 0xE8, 0xE8, 0xD0, 0xF1}); // STA $0200,X, INX 4 times, BNE
+	}
+	if (program == TestProgram::Sprite0Hit || program == TestProgram::ChrRam)
+	{
+		// Sprite 0 in the middle of the screen
+		code.insert(code.end(), {0xA9, 100, 0x8D, 0x00, 0x02});
+	}
+
+	// NMI on, then background only or background and sprites
+	code.insert(code.end(), {0xA9, 0x80, 0x8D, 0x00, 0x20});
+	code.insert(code.end(), {0xA9, static_cast<uint8_t>(program == TestProgram::Scrolling ? 0x0A : 0x1E), 0x8D, 0x01, 0x20});
+
+	const auto loop{static_cast<uint16_t>(0xC000 + code.size())};
+	if (program == TestProgram::Sprite0Hit || program == TestProgram::ChrRam)
+	{
+		// Waits for the hit, scrolls by the counter in 0x01 and waits for the flag to clear
+		code.insert(code.end(), {
+			0x2C, 0x02, 0x20, 0x50, 0xFB, // BIT $2002, BVC
+			0xE6, 0x01, 0xA5, 0x01, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, // INC $01, LDA $01, STA $2005 twice
+			0x2C, 0x02, 0x20, 0x70, 0xFB}); // BIT $2002, BVS
+	}
+	code.insert(code.end(), {0x4C, static_cast<uint8_t>(loop & 0xFF), static_cast<uint8_t>(loop >> 8)});
+	std::copy(code.begin(), code.end(), prg.begin());
+
+	std::vector<uint8_t> nmi;
+	if (program == TestProgram::ChrRam)
+	{
+		// Writes the frame counter XOR 0x5A to the pattern byte at counter & 0x0FFF
+		nmi.insert(nmi.end(), {
+			0xA5, 0x00, 0x29, 0x0F, 0x8D, 0x06, 0x20, // LDA $00, AND #$0F, STA $2006
+			0xA5, 0x00, 0x8D, 0x06, 0x20, // LDA $00, STA $2006
+			0xA5, 0x00, 0x49, 0x5A, 0x8D, 0x07, 0x20}); // LDA $00, EOR #$5A, STA $2007
+	}
+	if (program != TestProgram::Scrolling)
+	{
+		nmi.insert(nmi.end(), {0xA9, 0x02, 0x8D, 0x14, 0x40}); // OAM DMA from 0x0200
+	}
+	// Scrolls by the frame counter in 0x00, X by 1 and Y by 2 pixels, and cycles the nametable
+	nmi.insert(nmi.end(), {
+		0xE6, 0x00, 0xA5, 0x00, 0x8D, 0x05, 0x20, 0x0A, 0x8D, 0x05, 0x20,
+		0xA5, 0x00, 0x29, 0x03, 0x09, 0x80, 0x8D, 0x00, 0x20,
+		0x40}); // RTI
+	std::copy(nmi.begin(), nmi.end(), prg.begin() + 0x100);
+
+	for (size_t offset{0x1000}; offset < 0x3000; ++offset)
+	{
+		prg[offset] = random.next();
+	}
+
+	// NMI 0xC100, reset and IRQ 0xC000
+	const std::array<uint8_t, 6> vectors{0x00, 0xC1, 0x00, 0xC0, 0x00, 0xC0};
+	std::copy(vectors.begin(), vectors.end(), prg.end() - vectors.size());
+
+	if (program == TestProgram::ChrRam)
+	{
+		return buildINes(1, 0, verticalMirroring ? 0x01 : 0x00, prg);
+	}
+
+	std::vector<uint8_t> data{prg};
+	for (size_t offset{0}; offset < 0x2000; ++offset)
+	{
+		data.push_back(random.next());
+	}
+	return buildINes(1, 1, verticalMirroring ? 0x01 : 0x00, data);
+}
+
+// Hashes every scanline drawn, and each presented frame on its own
+class HashScreen : public Screen
+{
+public:
+	void drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override
+	{
+		m_frameHash = (m_frameHash ^ y ^ (emphasis << 8)) * prime;
+		for (const uint8_t index : paletteIndices)
+		{
+			m_frameHash = (m_frameHash ^ index) * prime;
+		}
+	}
+
+	void present() override
+	{
+		m_lastFrameHash = m_frameHash;
+		m_hash = (m_hash ^ m_frameHash) * prime;
+		m_frameHash = offsetBasis;
+		++m_frameCount;
+	}
+
+	// Of all frames presented so far
+	uint64_t m_hash{offsetBasis};
+	uint64_t m_lastFrameHash{0};
+	uint64_t m_frameCount{0};
+
+private:
+	// FNV-1a
+	static constexpr uint64_t offsetBasis{14695981039346656037ull};
+	static constexpr uint64_t prime{1099511628211ull};
+
+	uint64_t m_frameHash{offsetBasis};
+};
+
+} // namespace LibNes::Test
+
+#endif // TEST_ROM_H
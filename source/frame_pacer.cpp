@@ -0,0 +1,53 @@
+#include "frame_pacer.h"
+
+#include <thread>
+
+namespace NesEmulator
+{
+
+FramePacer::FramePacer(LibNes::Region region) :
+    m_timing{LibNes::getRegionTiming(region)},
+    m_started{false},
+    m_startTime{},
+    m_startCycle{0}
+{
+
+}
+
+void FramePacer::pace(uint64_t masterCycleCount)
+{
+    const auto now{std::chrono::steady_clock::now()};
+    if (!m_started)
+    {
+        m_started = true;
+        m_startTime = now;
+        m_startCycle = masterCycleCount;
+        return;
+    }
+
+    const auto target{m_startTime + getDuration(masterCycleCount - m_startCycle)};
+    if (now - target > maxLag)
+    {
+        m_startTime = now;
+        m_startCycle = masterCycleCount;
+        return;
+    }
+
+    std::this_thread::sleep_until(target);
+}
+
+// Exact in integer nanoseconds: whole seconds of the master clock and the remainder are converted
+// separately, so the products cannot overflow
+std::chrono::nanoseconds FramePacer::getDuration(uint64_t masterCycles) const
+{
+    constexpr uint64_t nanosecondsPerSecond{1000000000};
+    const uint64_t numerator{m_timing.m_masterClockNumerator};
+    const uint64_t denominator{m_timing.m_masterClockDenominator};
+
+    const uint64_t units{masterCycles / numerator};
+    const uint64_t remainder{masterCycles % numerator};
+    return std::chrono::nanoseconds{
+        units * denominator * nanosecondsPerSecond + remainder * denominator * nanosecondsPerSecond / numerator};
+}
+
+}
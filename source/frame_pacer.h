@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "libnes/region.h"
+
+namespace NesEmulator
+{
+
+// Throttles an emulation that never sleeps to real time. The target time is derived from the
+// emulated master clock cycles, so pacing doesn't drift however the runs are sliced.
+class FramePacer
+{
+public:
+    explicit FramePacer(LibNes::Region region);
+
+    // Sleeps until the wall clock reaches the given master clock cycle count. If the emulation
+    // falls further behind than maxLag, pacing restarts from now instead of racing to catch up.
+    void pace(uint64_t masterCycleCount);
+
+    static constexpr std::chrono::milliseconds maxLag{100};
+
+private:
+    LibNes::RegionTiming m_timing;
+    bool m_started;
+    std::chrono::steady_clock::time_point m_startTime;
+    uint64_t m_startCycle;
+
+    std::chrono::nanoseconds getDuration(uint64_t masterCycles) const;
+};
+
+}
@@ -1,25 +1,55 @@
 #include <atomic>
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <string_view>
 #include <thread>
 
 #include "libnes/nes.h"
 
+#include "frame_pacer.h"
 #include "screen_libgraphics.h"
 
 int main(int argc, char* argv[])
 {
 	if(argc < 2)
 	{
-		std::cout << "Usage: " << argv[0] << " inesFilePath\n";
+		std::cout << "Usage: " << argv[0] << " inesFilePath [--no-sprite-limit] [--threaded-ppu] [--region ntsc|pal|dendy] [--run-ahead N [--second-instance]]\n";
 		return EXIT_SUCCESS;
 	}
 	std::string filePath{argv[1]};
+	bool spriteLimit{true};
+	bool threadedPpu{false};
+	LibNes::Region region{LibNes::Region::Ntsc};
+	uint32_t runAheadFrames{0};
+	LibNes::Nes::RunAhead runAheadMode{LibNes::Nes::RunAhead::Restore};
+	for (int i{2}; i < argc; ++i)
+	{
+		const std::string_view option{argv[i]};
+		spriteLimit &= option != "--no-sprite-limit";
+		threadedPpu |= option == "--threaded-ppu";
+		if (option == "--second-instance")
+		{
+			runAheadMode = LibNes::Nes::RunAhead::SecondInstance;
+		}
+		if (option == "--run-ahead" && i + 1 < argc)
+		{
+			runAheadFrames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		if (option == "--region" && i + 1 < argc)
+		{
+			const std::string_view name{argv[++i]};
+			region = name == "pal" ? LibNes::Region::Pal : name == "dendy" ? LibNes::Region::Dendy : LibNes::Region::Ntsc;
+		}
+	}
 
 	std::shared_ptr<LibGraphics::Window> window{std::make_shared<LibGraphics::Window>("NesEmulator")};
 	std::shared_ptr<NesEmulator::ScreenLibGraphics> screen{std::make_shared<NesEmulator::ScreenLibGraphics>(window)};
 	LibNes::Nes nes{screen};
+	nes.setRegion(region);
+	nes.setSpriteLimit(spriteLimit);
+	nes.setThreadedRendering(threadedPpu);
 
 	std::ifstream file{filePath, std::ios::in | std::ios::binary | std::ios::ate};
 
@@ -29,22 +59,37 @@ int main(int argc, char* argv[])
 		return EXIT_FAILURE;
 	}
 	
-	nes.loadCartridge(file);
+	if (!nes.loadCartridge(file))
+	{
+		std::cerr << "Unsupported ines file: " << filePath << "\n";
+		return EXIT_FAILURE;
+	}
 	nes.reset();
+	nes.setRunAhead(runAheadFrames, runAheadMode);
 
+	// Emulation runs on its own thread and hands finished frames to the screen's triple buffer,
+	// so presenting never stalls the emulation and vice versa
+	std::atomic<bool> running{true};
+	std::thread emulation{[&]
+	{
 #if defined(NES_EMULATOR_LOG)
-	auto log = std::ofstream("nes.log");
+		auto log = std::ofstream("nes.log");
 #endif
+		NesEmulator::FramePacer pacer{region};
+		while (running)
+		{
+			nes.runFrame(
+#if defined(NES_EMULATOR_LOG)
+				log
+#endif
+			);
+			pacer.pace(nes.getMasterCycleCount());
+		}
+	}};
 
 	LibGraphics::Window::Event event;
 	while (window)
 	{
-		nes.runFor(std::chrono::milliseconds(16)
-#if defined(NES_EMULATOR_LOG)
-			, log
-#endif
-		);
-
 		screen->draw();
 		window->display();
 		if (window->pollEvent(event))
@@ -56,7 +101,13 @@ int main(int argc, char* argv[])
 				break;
 			}
 		}
+
+		// Frames arrive every 16 ms, don't spin if the display doesn't wait for vsync
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 
+	running = false;
+	emulation.join();
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "libnes/batch_runner.h"
+#include "libnes/buffered_screen.h"
+
+namespace
+{
+
+// Keeps a hash of the last presented frame, so runs can be compared against earlier ones
+class FrameHashScreen : public LibNes::Screen
+{
+public:
+	void drawScanline(uint16_t, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override
+	{
+		m_hash = (m_hash ^ LibNes::BufferedScreen::hashRow(paletteIndices, emphasis)) * 0x100000001B3ull;
+	}
+
+	void present() override
+	{
+		m_frameHash = m_hash;
+		m_hash = hashSeed;
+	}
+
+	uint64_t getFrameHash() const
+	{
+		return m_frameHash;
+	}
+
+private:
+	static constexpr uint64_t hashSeed{0xCBF29CE484222325ull};
+	uint64_t m_hash{hashSeed};
+	uint64_t m_frameHash{0};
+};
+
+}
+
+// Runs ROMs on many headless emulator instances in parallel and reports the throughput
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " [options] inesFilePath...\n"
+			"  --frames N                 Frames every instance runs (default 600)\n"
+			"  --instances N              Instances per ROM (default 1)\n"
+			"  --threads N                Worker threads (default: one per core)\n"
+			"  --region ntsc|pal|dendy    Console region (default ntsc)\n"
+			"  --hash                     Print a hash of the last frame of every instance\n"
+			"  --no-sprite-limit\n";
+		return EXIT_SUCCESS;
+	}
+
+	uint64_t frames{600};
+	uint64_t instances{1};
+	size_t threads{std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+	LibNes::Region region{LibNes::Region::Ntsc};
+	bool hash{false};
+	bool spriteLimit{true};
+	std::vector<std::string> filePaths;
+	for (int i{1}; i < argc; ++i)
+	{
+		const std::string_view option{argv[i]};
+		const bool hasValue{i + 1 < argc};
+		if (option == "--frames" && hasValue)
+		{
+			frames = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (option == "--instances" && hasValue)
+		{
+			instances = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (option == "--threads" && hasValue)
+		{
+			threads = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (option == "--region" && hasValue)
+		{
+			const std::string_view name{argv[++i]};
+			if (name != "ntsc" && name != "pal" && name != "dendy")
+			{
+				std::cerr << "Unknown region: " << name << "\n";
+				return EXIT_FAILURE;
+			}
+			region = name == "pal" ? LibNes::Region::Pal : name == "dendy" ? LibNes::Region::Dendy : LibNes::Region::Ntsc;
+		}
+		else if (option == "--hash")
+		{
+			hash = true;
+		}
+		else if (option == "--no-sprite-limit")
+		{
+			spriteLimit = false;
+		}
+		else if (option.starts_with("--"))
+		{
+			std::cerr << "Unknown option: " << option << "\n";
+			return EXIT_FAILURE;
+		}
+		else
+		{
+			filePaths.emplace_back(option);
+		}
+	}
+
+	std::vector<LibNes::BatchRunner::Job> jobs;
+	std::vector<std::shared_ptr<FrameHashScreen>> screens;
+	for (const std::string& filePath : filePaths)
+	{
+		std::ifstream file{filePath, std::ios::in | std::ios::binary};
+		if(!file.good())
+		{
+			std::cerr << "Failed to read ines file: " << filePath << "\n";
+			return EXIT_FAILURE;
+		}
+		const auto rom{std::make_shared<const std::string>(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{})};
+
+		for (uint64_t instance{0}; instance < instances; ++instance)
+		{
+			const auto screen{std::make_shared<FrameHashScreen>()};
+			screens.push_back(screen);
+			jobs.push_back({rom, frames, region, spriteLimit, [screen] { return screen; }});
+		}
+	}
+
+	LibNes::BatchRunner runner{threads};
+	const LibNes::BatchRunner::Report report{runner.run(jobs)};
+
+	bool failed{false};
+	for (size_t job{0}; job < jobs.size(); ++job)
+	{
+		const LibNes::BatchRunner::Result& result{report.m_results[job]};
+		std::cout << filePaths[job / instances] << " #" << job % instances << ": ";
+		if (!result.m_loaded)
+		{
+			std::cout << "unsupported ines file\n";
+			failed = true;
+			continue;
+		}
+
+		std::cout << result.m_frames << " frames in " << std::fixed << std::setprecision(1)
+			<< std::chrono::duration<double, std::milli>(result.m_time).count() << " ms on worker " << result.m_worker;
+		if (hash)
+		{
+			std::cout << ", hash " << std::hex << std::setw(16) << std::setfill('0') << screens[job]->getFrameHash()
+				<< std::dec << std::setfill(' ');
+		}
+		std::cout << "\n";
+	}
+
+	std::cout << jobs.size() << " instances, " << report.getFrameCount() << " frames in " << std::fixed << std::setprecision(2)
+		<< std::chrono::duration<double>(report.m_time).count() << " s on " << report.m_threadCount << " threads: "
+		<< std::setprecision(0) << report.getFramesPerSecond() << " frames/s, "
+		<< report.getFramesPerSecondPerCore() << " frames/s per core\n";
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "libnes/nes.h"
+#include "libnes/null_screen.h"
+#include "libnes/rewind_buffer.h"
+
+#include "frame_pacer.h"
+#include "screen_dump.h"
+#include "screen_shared_memory.h"
+#include "screen_video_stream.h"
+
+// Frontend without a window, for machines without X11 or GL
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " inesFilePath [options]\n"
+			"  --screen TYPE              null, ppm, raw, shm, y4m or rgb (default null)\n"
+			"  --frames N                 Stop after N frames (default: run until killed)\n"
+			"  --interval N               Dump every Nth frame (default 1)\n"
+			"  --output PATH              Dump file prefix (default frame_), shared memory name (default /nes_emulator)\n"
+			"                             or video file (default - for stdout)\n"
+			"  --slots N                  Frames in the shared memory ring or video queue (default 4)\n"
+			"  --region ntsc|pal|dendy    Console region (default ntsc)\n"
+			"  --realtime                 Throttle to the speed of the console instead of running as fast as possible\n"
+			"  --rewind MB                Capture every frame into a rewind buffer of this size and report its overhead\n"
+			"  --run-ahead N              Show frames N frames ahead to hide input latency and report the cost\n"
+			"  --second-instance          Run ahead on a second console instead of restoring the state\n"
+			"  --no-sprite-limit\n"
+			"  --threaded-ppu\n";
+		return EXIT_SUCCESS;
+	}
+	std::string filePath{argv[1]};
+
+	std::string_view screenType{"null"};
+	uint64_t frames{0};
+	uint32_t interval{1};
+	std::string output;
+	uint32_t slots{4};
+	bool spriteLimit{true};
+	bool threadedPpu{false};
+	LibNes::Region region{LibNes::Region::Ntsc};
+	bool realtime{false};
+	size_t rewindMegabytes{0};
+	uint32_t runAheadFrames{0};
+	LibNes::Nes::RunAhead runAheadMode{LibNes::Nes::RunAhead::Restore};
+	for (int i{2}; i < argc; ++i)
+	{
+		const std::string_view option{argv[i]};
+		const bool hasValue{i + 1 < argc};
+		if (option == "--screen" && hasValue)
+		{
+			screenType = argv[++i];
+		}
+		else if (option == "--frames" && hasValue)
+		{
+			frames = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (option == "--interval" && hasValue)
+		{
+			interval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (option == "--output" && hasValue)
+		{
+			output = argv[++i];
+		}
+		else if (option == "--slots" && hasValue)
+		{
+			slots = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (option == "--region" && hasValue)
+		{
+			const std::string_view name{argv[++i]};
+			if (name != "ntsc" && name != "pal" && name != "dendy")
+			{
+				std::cerr << "Unknown region: " << name << "\n";
+				return EXIT_FAILURE;
+			}
+			region = name == "pal" ? LibNes::Region::Pal : name == "dendy" ? LibNes::Region::Dendy : LibNes::Region::Ntsc;
+		}
+		else if (option == "--realtime")
+		{
+			realtime = true;
+		}
+		else if (option == "--rewind" && hasValue)
+		{
+			rewindMegabytes = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (option == "--run-ahead" && hasValue)
+		{
+			runAheadFrames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (option == "--second-instance")
+		{
+			runAheadMode = LibNes::Nes::RunAhead::SecondInstance;
+		}
+		else if (option == "--no-sprite-limit")
+		{
+			spriteLimit = false;
+		}
+		else if (option == "--threaded-ppu")
+		{
+			threadedPpu = true;
+		}
+		else
+		{
+			std::cerr << "Unknown option: " << option << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::shared_ptr<LibNes::Screen> screen;
+	std::function<uint64_t()> droppedFrames;
+	if (screenType == "null")
+	{
+		auto nullScreen{std::make_shared<LibNes::NullScreen>()};
+		screen = nullScreen;
+	}
+	else if (screenType == "ppm" || screenType == "raw")
+	{
+		auto dumpScreen{std::make_shared<NesEmulator::ScreenDump>(
+			output.empty() ? "frame_" : output, 
+			screenType == "ppm" ? NesEmulator::ScreenDump::Format::Ppm : NesEmulator::ScreenDump::Format::Raw, 
+			interval)};
+		screen = dumpScreen;
+	}
+	else if (screenType == "shm")
+	{
+		auto sharedMemoryScreen{NesEmulator::ScreenSharedMemory::create(output.empty() ? "/nes_emulator" : output, slots)};
+		if (!sharedMemoryScreen)
+		{
+			return EXIT_FAILURE;
+		}
+		screen = sharedMemoryScreen;
+	}
+	else if (screenType == "y4m" || screenType == "rgb")
+	{
+		const int descriptor{output.empty() || output == "-" ? 
+			STDOUT_FILENO : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+		if (descriptor < 0)
+		{
+			std::cerr << "Failed to open video output: " << output << "\n";
+			return EXIT_FAILURE;
+		}
+		// An encoder that exits early shows up as a write error instead of killing the process
+		std::signal(SIGPIPE, SIG_IGN);
+
+		// The descriptor is closed on exit, after the screen has written its queued frames
+		auto videoScreen{std::make_shared<NesEmulator::ScreenVideoStream>(descriptor, 
+			screenType == "y4m" ? NesEmulator::ScreenVideoStream::Format::Y4m : NesEmulator::ScreenVideoStream::Format::Rgb, 
+			slots, 
+			region)};
+		droppedFrames = [videoScreen] { return videoScreen->getDroppedFrames(); };
+		screen = videoScreen;
+	}
+	else
+	{
+		std::cerr << "Unknown screen: " << screenType << "\n";
+		return EXIT_FAILURE;
+	}
+
+	LibNes::Nes nes{screen};
+	nes.setRegion(region);
+	nes.setSpriteLimit(spriteLimit);
+	nes.setThreadedRendering(threadedPpu);
+
+	std::ifstream file{filePath, std::ios::in | std::ios::binary | std::ios::ate};
+
+	if(!file.good())
+	{
+		std::cerr << "Failed to read ines file: " << filePath << "\n";
+		return EXIT_FAILURE;
+	}
+	
+	if (!nes.loadCartridge(file))
+	{
+		std::cerr << "Unsupported ines file: " << filePath << "\n";
+		return EXIT_FAILURE;
+	}
+	nes.reset();
+	nes.setRunAhead(runAheadFrames, runAheadMode);
+
+#if defined(NES_EMULATOR_LOG)
+	auto log = std::ofstream("nes.log");
+#endif
+
+	std::optional<LibNes::RewindBuffer> rewind;
+	if (rewindMegabytes > 0)
+	{
+		rewind.emplace(rewindMegabytes << 20);
+	}
+
+	NesEmulator::FramePacer pacer{region};
+	while (frames == 0 || nes.getFrameCount() < frames)
+	{
+		if (rewind)
+		{
+			rewind->capture(nes);
+		}
+		nes.runFrame(
+#if defined(NES_EMULATOR_LOG)
+			log
+#endif
+		);
+		if (realtime)
+		{
+			pacer.pace(nes.getMasterCycleCount());
+		}
+	}
+
+	if (droppedFrames && droppedFrames() > 0)
+	{
+		std::cerr << "Dropped " << droppedFrames() << " of " << nes.getFrameCount() << " frames\n";
+	}
+
+	if (runAheadFrames > 0)
+	{
+		const LibNes::Nes::RunAheadStatistics statistics{nes.getRunAheadStatistics()};
+		std::cerr << "Run-ahead: " << std::fixed << std::setprecision(1)
+			<< std::chrono::duration<double, std::micro>(statistics.getRunAheadTimePerFrame()).count() << " us per frame on top of "
+			<< std::chrono::duration<double, std::micro>(statistics.m_frameTime).count() / std::max<uint64_t>(statistics.m_frames, 1)
+			<< " us for the frame itself\n";
+	}
+
+	if (rewind)
+	{
+		const LibNes::RewindBuffer::Statistics statistics{rewind->getStatistics()};
+		const LibNes::RegionTiming timing{LibNes::getRegionTiming(region)};
+		const double frameRate{static_cast<double>(timing.m_masterClockNumerator) / timing.m_masterClockDenominator /
+			(LibNes::Ricoh2C02::cyclesPerScanline * timing.m_scanlineCount * timing.m_masterCyclesPerPpuCycle)};
+		std::cerr << "Rewind: " << statistics.m_storedFrames << " frames (" << std::fixed << std::setprecision(1)
+			<< statistics.m_storedFrames / frameRate << " s) in " << statistics.m_storedBytes / 1048576.0 << " of "
+			<< rewindMegabytes << " MB, compressed " << statistics.getCompressionRatio() << "x, "
+			<< std::setprecision(2) << std::chrono::duration<double, std::micro>(statistics.getAverageCaptureTime()).count()
+			<< " us per frame\n";
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include "screen_dump.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace NesEmulator
+{
+
+ScreenDump::ScreenDump(const std::string& pathPrefix, Format format, uint32_t interval) :
+    m_pathPrefix{pathPrefix},
+    m_format{format},
+    m_interval{interval > 0 ? interval : 1},
+    m_frameCount{0},
+    m_converter{LibNes::PaletteConverter::Format::Rgba8888},
+    m_row(width * m_converter.getBytesPerPixel()),
+    m_pixels(width * height * bytesPerPixel)
+{
+
+}
+
+void ScreenDump::drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis)
+{
+    if (!isDumped())
+    {
+        return;
+    }
+
+    m_converter.convert(paletteIndices, emphasis, m_row.data());
+    uint8_t* const pixels{&m_pixels[y * width * bytesPerPixel]};
+    for (size_t x = 0; x < width; ++x)
+    {
+        pixels[x * 3 + 0] = m_row[x * 4 + 0];
+        pixels[x * 3 + 1] = m_row[x * 4 + 1];
+        pixels[x * 3 + 2] = m_row[x * 4 + 2];
+    }
+}
+
+void ScreenDump::present()
+{
+    if (isDumped())
+    {
+        std::ostringstream path;
+        path << m_pathPrefix << std::setw(6) << std::setfill('0') << getFrameCount() 
+            << (m_format == Format::Ppm ? ".ppm" : ".rgb");
+
+        std::ofstream file{path.str(), std::ios::out | std::ios::binary};
+        if (m_format == Format::Ppm)
+        {
+            file << "P6\n" << width << " " << height << "\n255\n";
+        }
+        file.write(reinterpret_cast<const char*>(m_pixels.data()), m_pixels.size());
+
+        if (!file.good())
+        {
+            std::cerr << "Failed to write frame dump: " << path.str() << "\n";
+        }
+    }
+
+    m_frameCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t ScreenDump::getFrameCount() const
+{
+    return m_frameCount.load(std::memory_order_relaxed);
+}
+
+bool ScreenDump::isDumped() const
+{
+    return getFrameCount() % m_interval == 0;
+}
+
+}
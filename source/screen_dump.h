@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "libnes/palette_converter.h"
+#include "libnes/screen.h"
+
+namespace NesEmulator
+{
+
+// Writes every interval-th frame to its own file, named pathPrefix followed by the frame number.
+// Ppm files are binary PPM (P6), raw files the same 24 bit RGB pixels without a header.
+class ScreenDump : public LibNes::Screen
+{
+public:
+    enum class Format { Ppm, Raw };
+
+    ScreenDump(const std::string& pathPrefix, Format format, uint32_t interval);
+
+    void drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override;
+    void present() override;
+
+    uint64_t getFrameCount() const;
+
+private:
+    std::string m_pathPrefix;
+    Format m_format;
+    uint32_t m_interval;
+    std::atomic<uint64_t> m_frameCount;
+
+    LibNes::PaletteConverter m_converter;
+    std::vector<uint8_t> m_row; // RGBA
+    std::vector<uint8_t> m_pixels; // RGB
+
+    bool isDumped() const;
+    static constexpr size_t bytesPerPixel{3};
+};
+
+}
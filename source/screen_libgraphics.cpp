@@ -16,21 +16,71 @@ ScreenLibGraphics::ScreenLibGraphics(NonNullSharedPtr<Window> window) :
         Vector<float>{2.0f,2.0f},
         Color{0, 0, 0},
         m_texture},
-    m_window{window}
+    m_window{window},
+    m_converter{LibNes::PaletteConverter::Format::Rgba8888},
+    m_pixels(width * height * m_converter.getBytesPerPixel()),
+    m_uploadedHashes{},
+    m_textureValid{false},
+    m_bytesUploaded{0}
 {
     
 }
 
 void ScreenLibGraphics::draw()
 {
+    if (acquireFrame())
+    {
+        const Frame& frame{getFrame()};
+        m_bytesUploaded = 0;
+
+        // Uploads ranges of consecutive changed rows
+        uint16_t y = 0;
+        while (y < height)
+        {
+            if (m_textureValid && frame.m_rowHashes[y] == m_uploadedHashes[y])
+            {
+                ++y;
+                continue;
+            }
+
+            const uint16_t begin{y};
+            while (y < height && (!m_textureValid || frame.m_rowHashes[y] != m_uploadedHashes[y]))
+            {
+                ++y;
+            }
+            uploadRows(frame, begin, y);
+        }
+
+        m_uploadedHashes = frame.m_rowHashes;
+        m_textureValid = true;
+    }
+
     m_window->draw(m_rectangle);
 }
 
-void ScreenLibGraphics::draw(LibNes::Screen::Pixel const &pixel)
+size_t ScreenLibGraphics::getBytesUploaded() const
 {
-    m_texture->setPixel(
-        Texture::PositionVector{pixel.position.x, pixel.position.y}, 
-        Color{pixel.color.r, pixel.color.g, pixel.color.b});
+    return m_bytesUploaded;
+}
+
+void ScreenLibGraphics::uploadRows(const Frame& frame, uint16_t begin, uint16_t end)
+{
+    for (uint16_t y = begin; y < end; ++y)
+    {
+        uint8_t* const row{&m_pixels[y * width * m_converter.getBytesPerPixel()]};
+        m_converter.convert(
+            std::span<const uint8_t>{frame.m_paletteIndices.data() + y * width, width}, 
+            frame.m_emphasis[y], 
+            row);
+
+        for (uint16_t x = 0; x < width; ++x)
+        {
+            const uint8_t* pixel{&row[x * 4]};
+            m_texture->setPixel(Texture::PositionVector{x, y}, Color{pixel[0], pixel[1], pixel[2]});
+        }
+    }
+
+    m_bytesUploaded += (end - begin) * width * Texture::bytesPerPixel;
 }
 
 }
\ No newline at end of file
@@ -1,26 +1,44 @@
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "libgraphics/rectangle.h"
 #include "libgraphics/window.h"
 
-#include "libnes/screen.h"
+#include "libnes/buffered_screen.h"
+#include "libnes/palette_converter.h"
 
 namespace NesEmulator
 {
 
-class ScreenLibGraphics : public LibNes::Screen
+// Frames arrive from the emulation thread, draw() is called from the display thread
+class ScreenLibGraphics : public LibNes::BufferedScreen
 {
 public:
     ScreenLibGraphics() = delete;
     ScreenLibGraphics(NonNullSharedPtr<LibGraphics::Window> window);
 
     void draw();
-    void draw(LibNes::Screen::Pixel const &pixel) override;
+
+    // Bytes uploaded to the texture for the last frame, only rows that changed are uploaded
+    size_t getBytesUploaded() const;
 
 private:
     NonNullSharedPtr<LibGraphics::Window> m_window;
     NonNullSharedPtr<LibGraphics::Texture> m_texture;
     LibGraphics::Rectangle m_rectangle;
+
+    // The emulator only stores palette indices, they are converted when a new frame is drawn
+    LibNes::PaletteConverter m_converter;
+    std::vector<uint8_t> m_pixels;
+
+    // Row hashes of the frame in the texture
+    std::array<uint64_t, height> m_uploadedHashes;
+    bool m_textureValid;
+    size_t m_bytesUploaded;
+
+    void uploadRows(const Frame& frame, uint16_t begin, uint16_t end);
 };
 
 }
\ No newline at end of file
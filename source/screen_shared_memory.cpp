@@ -0,0 +1,102 @@
+#include "screen_shared_memory.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <new>
+
+namespace NesEmulator
+{
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Frame counters are shared between processes");
+
+std::shared_ptr<ScreenSharedMemory> ScreenSharedMemory::create(const std::string& name, uint32_t slotCount)
+{
+    slotCount = slotCount > 0 ? slotCount : 1;
+    const size_t slotSize{sizeof(SlotHeader) + width * height * 4};
+    const size_t size{sizeof(Header) + slotCount * slotSize};
+
+    const int descriptor{shm_open(name.c_str(), O_CREAT | O_RDWR, 0600)};
+    if (descriptor < 0)
+    {
+        std::cerr << "Failed to open shared memory: " << name << "\n";
+        return nullptr;
+    }
+
+    void* memory{MAP_FAILED};
+    if (ftruncate(descriptor, static_cast<off_t>(size)) == 0)
+    {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    }
+    close(descriptor);
+
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory: " << name << "\n";
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    new (memory) Header{magic, version, width, height, 4, slotCount, slotSize, {0}};
+    for (uint32_t slot = 0; slot < slotCount; ++slot)
+    {
+        new (static_cast<uint8_t*>(memory) + sizeof(Header) + slot * slotSize) SlotHeader{{0}, {}};
+    }
+
+    return std::shared_ptr<ScreenSharedMemory>{new ScreenSharedMemory{name, static_cast<uint8_t*>(memory), size}};
+}
+
+ScreenSharedMemory::ScreenSharedMemory(const std::string& name, uint8_t* memory, size_t size) :
+    m_name{name},
+    m_memory{memory},
+    m_size{size},
+    m_header{reinterpret_cast<Header*>(memory)},
+    m_frame{1},
+    m_converter{LibNes::PaletteConverter::Format::Rgba8888}
+{
+
+}
+
+ScreenSharedMemory::~ScreenSharedMemory()
+{
+    // Processes that mapped the object keep their mapping
+    munmap(m_memory, m_size);
+    shm_unlink(m_name.c_str());
+}
+
+void ScreenSharedMemory::drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis)
+{
+    if (y == 0)
+    {
+        getSlot(m_frame).m_frame.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    m_converter.convert(paletteIndices, emphasis, getPixels(m_frame) + y * width * 4);
+}
+
+void ScreenSharedMemory::present()
+{
+    getSlot(m_frame).m_frame.store(m_frame, std::memory_order_release);
+    m_header->m_frameCount.store(m_frame, std::memory_order_release);
+    ++m_frame;
+}
+
+uint64_t ScreenSharedMemory::getFrameCount() const
+{
+    return m_header->m_frameCount.load(std::memory_order_relaxed);
+}
+
+ScreenSharedMemory::SlotHeader& ScreenSharedMemory::getSlot(uint64_t frame) const
+{
+    return *reinterpret_cast<SlotHeader*>(m_memory + sizeof(Header) + (frame - 1) % m_header->m_slotCount * m_header->m_slotSize);
+}
+
+uint8_t* ScreenSharedMemory::getPixels(uint64_t frame) const
+{
+    return reinterpret_cast<uint8_t*>(&getSlot(frame)) + sizeof(SlotHeader);
+}
+
+}
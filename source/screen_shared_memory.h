@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "libnes/palette_converter.h"
+#include "libnes/screen.h"
+
+namespace NesEmulator
+{
+
+// Publishes frames as RGBA pixels in a POSIX shared memory ring, which other processes map and
+// read in place. The object starts with a Header, followed by slotCount slots of m_slotSize bytes,
+// each a SlotHeader followed by the pixels.
+//
+// Frame n (counting from 1) goes into slot (n - 1) % slotCount. Readers load m_frameCount, read the
+// pixels of its slot and then check that the slot's m_frame still equals the frame they wanted;
+// the slot is being rewritten otherwise.
+class ScreenSharedMemory : public LibNes::Screen
+{
+public:
+    struct Header
+    {
+        uint32_t m_magic;
+        uint32_t m_version;
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_bytesPerPixel;
+        uint32_t m_slotCount;
+        uint64_t m_slotSize;
+        std::atomic<uint64_t> m_frameCount; // Last complete frame
+    };
+
+    struct SlotHeader
+    {
+        std::atomic<uint64_t> m_frame; // Complete frame in the slot, 0 while it is written
+        uint64_t m_padding[7];
+    };
+
+    static constexpr uint32_t magic{0x4E455346}; // "NESF"
+    static constexpr uint32_t version{1};
+
+    // Creates the shared memory object name (e.g. "/nes_emulator"), nullptr on failure
+    static std::shared_ptr<ScreenSharedMemory> create(const std::string& name, uint32_t slotCount);
+    ~ScreenSharedMemory();
+
+    ScreenSharedMemory(const ScreenSharedMemory&) = delete;
+    ScreenSharedMemory& operator=(const ScreenSharedMemory&) = delete;
+
+    void drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override;
+    void present() override;
+
+    uint64_t getFrameCount() const;
+
+private:
+    ScreenSharedMemory(const std::string& name, uint8_t* memory, size_t size);
+
+    std::string m_name;
+    uint8_t* m_memory;
+    size_t m_size;
+    Header* m_header;
+    uint64_t m_frame; // Frame being written, counting from 1
+
+    LibNes::PaletteConverter m_converter;
+
+    SlotHeader& getSlot(uint64_t frame) const;
+    uint8_t* getPixels(uint64_t frame) const;
+};
+
+}
@@ -0,0 +1,317 @@
+#include "screen_video_stream.h"
+
+#include "libnes/ricoh_2c02.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace NesEmulator
+{
+
+namespace
+{
+    constexpr const char* y4mFrameHeader{"FRAME\n"};
+
+    constexpr size_t chromaWidth{LibNes::Screen::width / 2};
+    constexpr size_t chromaHeight{LibNes::Screen::height / 2};
+    constexpr size_t lumaSize{LibNes::Screen::width * LibNes::Screen::height};
+    constexpr size_t chromaSize{chromaWidth * chromaHeight};
+
+    // The frame rate is the master clock over the master cycles of a frame, as an exact fraction
+    std::string getY4mHeader(LibNes::Region region)
+    {
+        const LibNes::RegionTiming timing{LibNes::getRegionTiming(region)};
+        const uint64_t numerator{timing.m_masterClockNumerator};
+        const uint64_t denominator{timing.m_masterClockDenominator * timing.m_masterCyclesPerPpuCycle * 
+            LibNes::Ricoh2C02::cyclesPerScanline * static_cast<uint64_t>(timing.m_scanlineCount)};
+        const uint64_t divisor{std::gcd(numerator, denominator)};
+        return "YUV4MPEG2 W256 H240 F" + std::to_string(numerator / divisor) + ":" + std::to_string(denominator / divisor) + 
+            " Ip A8:7 C420jpeg\n";
+    }
+
+    uint8_t getLuma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    uint8_t getBlueDifference(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    uint8_t getRedDifference(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+ScreenVideoStream::ScreenVideoStream(int descriptor, Format format, size_t queuedFrames, LibNes::Region region) :
+    m_descriptor{descriptor},
+    m_format{format},
+    m_header{format == Format::Y4m ? getY4mHeader(region) : ""},
+    m_slots(std::clamp<size_t>(queuedFrames, 1, maxQueuedFrames)),
+    m_slot{noSlot},
+    m_frameCount{0},
+    m_writtenFrames{0},
+    m_droppedFrames{0},
+    m_converter{LibNes::PaletteConverter::Format::Rgba8888},
+    m_rgba(width * height * m_converter.getBytesPerPixel()),
+    m_output(format == Format::Y4m ? std::strlen(y4mFrameHeader) + lumaSize + 2 * chromaSize : width * height * 3),
+    m_failed{false}
+{
+    for (size_t slot = 0; slot < m_slots.size(); ++slot)
+    {
+        m_freeSlots.tryPush(slot);
+    }
+
+    m_writer = std::thread{&ScreenVideoStream::writeFrames, this};
+}
+
+ScreenVideoStream::~ScreenVideoStream()
+{
+    while (!m_queuedSlots.tryPush(stopSlot))
+    {
+        std::this_thread::yield();
+    }
+    m_queuedSlots.notify();
+    m_writer.join();
+}
+
+void ScreenVideoStream::drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis)
+{
+    // A frame that never got presented keeps its slot. Without a free slot the frame is dropped.
+    if (y == 0 && m_slot == noSlot)
+    {
+        m_freeSlots.tryPop(m_slot);
+    }
+    if (m_slot == noSlot)
+    {
+        return;
+    }
+
+    Slot& slot{m_slots[m_slot]};
+    std::copy(paletteIndices.begin(), paletteIndices.end(), slot.m_paletteIndices.begin() + y * width);
+    slot.m_emphasis[y] = emphasis;
+}
+
+void ScreenVideoStream::present()
+{
+    if (m_slot != noSlot)
+    {
+        m_queuedSlots.tryPush(m_slot);
+        m_queuedSlots.notify();
+        m_slot = noSlot;
+    }
+    else
+    {
+        m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    m_frameCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t ScreenVideoStream::getFrameCount() const
+{
+    return m_frameCount.load(std::memory_order_relaxed);
+}
+
+uint64_t ScreenVideoStream::getWrittenFrames() const
+{
+    return m_writtenFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t ScreenVideoStream::getDroppedFrames() const
+{
+    return m_droppedFrames.load(std::memory_order_relaxed);
+}
+
+void ScreenVideoStream::writeFrames()
+{
+    write(reinterpret_cast<const uint8_t*>(m_header.data()), m_header.size());
+
+    while (true)
+    {
+        size_t slot;
+        if (!m_queuedSlots.tryPop(slot))
+        {
+            m_queuedSlots.wait();
+            continue;
+        }
+        if (slot == stopSlot)
+        {
+            return;
+        }
+
+        convert(m_slots[slot]);
+        m_freeSlots.tryPush(slot);
+
+        if (write(m_output.data(), m_output.size()))
+        {
+            m_writtenFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ScreenVideoStream::convert(const Slot& slot)
+{
+    m_converter.convertFrame(slot.m_paletteIndices, slot.m_emphasis, m_rgba.data());
+
+    const size_t rgbaPitch{width * m_converter.getBytesPerPixel()};
+    if (m_format == Format::Rgb)
+    {
+        for (size_t pixel = 0; pixel < width * height; ++pixel)
+        {
+            std::memcpy(&m_output[pixel * 3], &m_rgba[pixel * 4], 3);
+        }
+        return;
+    }
+
+    const size_t headerSize{std::strlen(y4mFrameHeader)};
+    std::memcpy(m_output.data(), y4mFrameHeader, headerSize);
+    uint8_t* const luma{m_output.data() + headerSize};
+    uint8_t* const blueDifference{luma + lumaSize};
+    uint8_t* const redDifference{blueDifference + chromaSize};
+    for (size_t y = 0; y < height; y += 2)
+    {
+        convertRowsToYuv420(
+            &m_rgba[y * rgbaPitch], &m_rgba[(y + 1) * rgbaPitch],
+            luma + y * width, luma + (y + 1) * width,
+            blueDifference + y / 2 * chromaWidth, redDifference + y / 2 * chromaWidth);
+    }
+}
+
+bool ScreenVideoStream::write(const uint8_t* data, size_t size)
+{
+    if (m_failed)
+    {
+        return false;
+    }
+
+    while (size > 0)
+    {
+        const ssize_t written{::write(m_descriptor, data, size)};
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Keep draining the queue so the emulation carries on
+            std::cerr << "Failed to write video stream: " << std::strerror(errno) << "\n";
+            m_failed = true;
+            return false;
+        }
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void ScreenVideoStream::convertRowsToYuv420(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+#if defined(__SSE2__)
+    // 16 pixels of both rows per iteration. Channels are spread to 16 bit lanes, where the luma
+    // sum fits unsigned and the chroma sums of averaged pixels fit signed.
+    const __m128i byteMask{_mm_set1_epi32(0xFF)};
+    const auto load = [&byteMask](const uint8_t* rgba, __m128i& r, __m128i& g, __m128i& b)
+    {
+        const __m128i low{_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba))};
+        const __m128i high{_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + 16))};
+        r = _mm_packs_epi32(_mm_and_si128(low, byteMask), _mm_and_si128(high, byteMask));
+        g = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(low, 8), byteMask), _mm_and_si128(_mm_srli_epi32(high, 8), byteMask));
+        b = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(low, 16), byteMask), _mm_and_si128(_mm_srli_epi32(high, 16), byteMask));
+    };
+    const auto getLumaVector = [](__m128i r, __m128i g, __m128i b)
+    {
+        __m128i sum{_mm_mullo_epi16(r, _mm_set1_epi16(66))};
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+        sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+        return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+    };
+    const auto getChromaVector = [](__m128i r, __m128i g, __m128i b, int16_t rFactor, int16_t gFactor, int16_t bFactor)
+    {
+        __m128i sum{_mm_mullo_epi16(r, _mm_set1_epi16(rFactor))};
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi16(gFactor)));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(bFactor)));
+        sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+        return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+    };
+    // Adds horizontal pairs of two rows of 8 channel values each, leaving 4 sums in 32 bit lanes
+    const auto sumPairs = [](__m128i row0, __m128i row1)
+    {
+        return _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+    };
+    // Rounded average of four pixels from the sums of two groups of 4
+    const auto average = [](__m128i sumsLow, __m128i sumsHigh)
+    {
+        return _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(sumsLow, sumsHigh), _mm_set1_epi16(2)), 2);
+    };
+
+    for (size_t x = 0; x < width; x += 16)
+    {
+        __m128i r0[2], g0[2], b0[2], r1[2], g1[2], b1[2];
+        for (size_t half = 0; half < 2; ++half)
+        {
+            load(rgba0 + (x + half * 8) * 4, r0[half], g0[half], b0[half]);
+            load(rgba1 + (x + half * 8) * 4, r1[half], g1[half], b1[half]);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(
+            getLumaVector(r0[0], g0[0], b0[0]), getLumaVector(r0[1], g0[1], b0[1])));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(
+            getLumaVector(r1[0], g1[0], b1[0]), getLumaVector(r1[1], g1[1], b1[1])));
+
+        const __m128i r{average(sumPairs(r0[0], r1[0]), sumPairs(r0[1], r1[1]))};
+        const __m128i g{average(sumPairs(g0[0], g1[0]), sumPairs(g0[1], g1[1]))};
+        const __m128i b{average(sumPairs(b0[0], b1[0]), sumPairs(b0[1], b1[1]))};
+        const __m128i chroma{_mm_packus_epi16(getChromaVector(r, g, b, -38, -74, 112), getChromaVector(r, g, b, 112, -94, -18))};
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), chroma);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_srli_si128(chroma, 8));
+    }
+#else
+    convertRowsToYuv420Scalar(rgba0, rgba1, y0, y1, u, v);
+#endif
+}
+
+void ScreenVideoStream::convertRowsToYuv420Scalar(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    for (size_t x = 0; x < width; x += 2)
+    {
+        int r{0}, g{0}, b{0};
+        for (const uint8_t* pixel : {rgba0 + x * 4, rgba0 + x * 4 + 4, rgba1 + x * 4, rgba1 + x * 4 + 4})
+        {
+            r += pixel[0];
+            g += pixel[1];
+            b += pixel[2];
+        }
+        for (size_t i = 0; i < 2; ++i)
+        {
+            const uint8_t* const pixel0{rgba0 + (x + i) * 4};
+            const uint8_t* const pixel1{rgba1 + (x + i) * 4};
+            y0[x + i] = getLuma(pixel0[0], pixel0[1], pixel0[2]);
+            y1[x + i] = getLuma(pixel1[0], pixel1[1], pixel1[2]);
+        }
+
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+        u[x / 2] = getBlueDifference(r, g, b);
+        v[x / 2] = getRedDifference(r, g, b);
+    }
+}
+
+}
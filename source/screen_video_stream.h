@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libnes/palette_converter.h"
+#include "libnes/region.h"
+#include "libnes/screen.h"
+#include "libnes/spsc_queue.h"
+
+namespace NesEmulator
+{
+
+// Streams every frame to a file descriptor, e.g. a file or a pipe into an encoder, either as Y4M
+// (YUV 4:2:0, BT.601 limited range) or as raw 24 bit RGB frames without any header.
+//
+// The emulation only copies palette indices into a free frame slot. Conversion and writing happen
+// on a writer thread, so a stalled disk or encoder never blocks the emulation: once all slots are
+// queued, further frames are dropped and counted instead.
+class ScreenVideoStream : public LibNes::Screen
+{
+public:
+    enum class Format { Y4m, Rgb };
+
+    static constexpr size_t maxQueuedFrames{8};
+
+    // The descriptor stays owned by the caller and has to outlive the screen. The region sets the
+    // frame rate in the Y4M header.
+    ScreenVideoStream(
+        int descriptor, Format format, size_t queuedFrames = maxQueuedFrames, LibNes::Region region = LibNes::Region::Ntsc);
+    // Writes the frames still queued before returning
+    ~ScreenVideoStream();
+
+    ScreenVideoStream(const ScreenVideoStream&) = delete;
+    ScreenVideoStream& operator=(const ScreenVideoStream&) = delete;
+
+    void drawScanline(uint16_t y, std::span<const uint8_t, width> paletteIndices, uint8_t emphasis) override;
+    void present() override;
+
+    // Frames presented, written and dropped because the queue was full
+    uint64_t getFrameCount() const;
+    uint64_t getWrittenFrames() const;
+    uint64_t getDroppedFrames() const;
+
+    // Converts two RGBA rows to two rows of luma and one row of 2x2 averaged chroma
+    static void convertRowsToYuv420(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+
+private:
+    struct Slot
+    {
+        std::array<uint8_t, width * height> m_paletteIndices;
+        std::array<uint8_t, height> m_emphasis;
+    };
+
+    int m_descriptor;
+    Format m_format;
+    std::string m_header;
+
+    std::vector<Slot> m_slots;
+    static constexpr size_t noSlot{maxQueuedFrames};
+    size_t m_slot; // Slot receiving the current frame, noSlot while the frame is dropped
+    // Filled slots go to the writer, written ones come back
+    LibNes::SpscQueue<size_t, maxQueuedFrames> m_queuedSlots;
+    LibNes::SpscQueue<size_t, maxQueuedFrames> m_freeSlots;
+    static constexpr size_t stopSlot{maxQueuedFrames + 1};
+
+    std::atomic<uint64_t> m_frameCount;
+    std::atomic<uint64_t> m_writtenFrames;
+    std::atomic<uint64_t> m_droppedFrames;
+
+    LibNes::PaletteConverter m_converter;
+    std::vector<uint8_t> m_rgba;
+    std::vector<uint8_t> m_output;
+    bool m_failed;
+
+    std::thread m_writer;
+    void writeFrames();
+    void convert(const Slot& slot);
+    bool write(const uint8_t* data, size_t size);
+
+    static void convertRowsToYuv420Scalar(const uint8_t* rgba0, const uint8_t* rgba1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+};
+
+}